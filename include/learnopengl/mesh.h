@@ -27,9 +27,29 @@ struct Vertex {
 
 
 
+enum class TextureType {
+    Diffuse,
+    Specular,
+    Normal,
+    Height
+};
+
+// sampler names in the shaders are these followed by the number of the texture of that type: texture_diffuse1, ...
+inline const char *textureTypeName(TextureType type)
+{
+    switch(type)
+    {
+        case TextureType::Diffuse:  return "texture_diffuse";
+        case TextureType::Specular: return "texture_specular";
+        case TextureType::Normal:   return "texture_normal";
+        case TextureType::Height:   return "texture_height";
+    }
+    return "";
+}
+
 struct Texture {
     unsigned int id;
-    string type;
+    TextureType type;
     string path;
 };
 
@@ -40,14 +60,18 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // every sampler has a fixed unit, texture_diffuseN is on unit N-1, texture_specularN on
+    // MaxTexturesPerType + N-1 and so on, so meshes drawn with the same program agree on the units
+    static const unsigned int MaxTexturesPerType = 4;
+
     unsigned int VAO;
-    std::string glslIdentifierPrefix;
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        assignUnits();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
@@ -56,46 +80,82 @@ public:
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-
-
+        bindTextures(shader);
 
         // draw mesh
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
+    }
 
+    // binds the textures to their units; the first time with a program, expects it in use
+    void bindTextures(Shader &shader)
+    {
+        if(!isResolved(shader.Generation))
+            resolveSamplers(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            if(textureUnits[i] < 0)
+                continue;
+            glActiveTexture(GL_TEXTURE0 + textureUnits[i]);
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // prefix of the sampler names, e.g. "material." for samplers in a struct uniform
+    void setGlslIdentifierPrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        resolvedPrograms.clear();
+    }
+
 private:
     // render data
     unsigned int VBO, EBO;
+    std::string glslIdentifierPrefix;
+    // unit of each texture, -1 past MaxTexturesPerType of a type
+    vector<int> textureUnits;
+    // Shader::Generation of the programs whose samplers already point at the units
+    vector<unsigned int> resolvedPrograms;
+
+    void assignUnits()
+    {
+        unsigned int count[4] = {0, 0, 0, 0};
+        for(const Texture &texture : textures)
+        {
+            unsigned int type = (unsigned int) texture.type;
+            unsigned int number = count[type]++;
+            textureUnits.push_back(number < MaxTexturesPerType ? (int) (type * MaxTexturesPerType + number) : -1);
+        }
+    }
+
+    bool isResolved(unsigned int generation) const
+    {
+        for(unsigned int resolved : resolvedPrograms)
+        {
+            if(resolved == generation)
+                return true;
+        }
+        return false;
+    }
+
+    // the only place sampler names are built; the units don't depend on the mesh, so setting them
+    // again for another mesh drawn with the program changes nothing
+    void resolveSamplers(Shader &shader)
+    {
+        unsigned int count[4] = {0, 0, 0, 0};
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            unsigned int number = ++count[(unsigned int) textures[i].type];
+            if(textureUnits[i] < 0)
+                continue;
+            string name = glslIdentifierPrefix + textureTypeName(textures[i].type) + std::to_string(number);
+            glUniform1i(glGetUniformLocation(shader.ID, name.c_str()), textureUnits[i]);
+        }
+        resolvedPrograms.push_back(shader.Generation);
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
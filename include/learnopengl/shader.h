@@ -8,14 +8,25 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 #include <common.h>
 class Shader
 {
 public:
     unsigned int ID;
+    // never the same for two programs, unlike ID, which GL hands out again once a program is deleted
+    unsigned int Generation;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+        : Shader(vertexPath, fragmentPath, std::string(), geometryPath)
+    {
+    }
+    // prelude is inserted into every stage right after its #version line, for
+    // #defines and constants that are only known at program-build time
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &prelude, const char* geometryPath = nullptr)
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -64,6 +75,22 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        std::vector<std::string> included;
+        vertexCode = resolveIncludes(vertexCode, vertexPath, included);
+        included.clear();
+        fragmentCode = resolveIncludes(fragmentCode, fragmentPath, included);
+        if(geometryPath != nullptr)
+        {
+            included.clear();
+            geometryCode = resolveIncludes(geometryCode, geometryPath, included);
+        }
+        if(!prelude.empty())
+        {
+            vertexCode = insertPrelude(vertexCode, prelude);
+            fragmentCode = insertPrelude(fragmentCode, prelude);
+            if(geometryPath != nullptr)
+                geometryCode = insertPrelude(geometryCode, prelude);
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -90,6 +117,7 @@ public:
         }
         // shader Program
         ID = glCreateProgram();
+        Generation = nextGeneration();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
@@ -167,8 +195,78 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    // GLSL 330 has no layout(binding = n) for uniform blocks, they get theirs from here
+    // ------------------------------------------------------------------------
+    void setUniformBlock(const std::string &name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if(index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
 
 private:
+    // counts the programs built, from 1
+    // ------------------------------------------------------------------------
+    static unsigned int nextGeneration()
+    {
+        static unsigned int generations = 0;
+        return ++generations;
+    }
+    // the #version directive has to stay the first line of the source, the #line after the
+    // prelude keeps compiler errors pointing at the lines of the file
+    // ------------------------------------------------------------------------
+    static std::string insertPrelude(const std::string &code, const std::string &prelude)
+    {
+        std::string::size_type version = code.find("#version");
+        std::string::size_type lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if(lineEnd == std::string::npos)
+            return prelude + "\n" + code;
+        int nextLine = (int)std::count(code.begin(), code.begin() + lineEnd, '\n') + 2;
+        return code.substr(0, lineEnd + 1) + prelude + "\n#line " + std::to_string(nextLine) + "\n" + code.substr(lineEnd + 1);
+    }
+    // Replaces every #include "file" line with the contents of file, looked up next to the
+    // file that includes it. Each file goes in once per stage, so shared headers need no
+    // guards. Included code is numbered as source string 1, 2, ... in the order it was first
+    // included, which is what the compiler prints in front of the line number.
+    // ------------------------------------------------------------------------
+    static std::string resolveIncludes(const std::string &code, const std::string &path, std::vector<std::string> &included)
+    {
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        int source = (int)included.size();
+        std::istringstream lines(code);
+        std::ostringstream result;
+        std::string line;
+        int lineNumber = 0;
+        while(std::getline(lines, line))
+        {
+            lineNumber++;
+            std::string::size_type start = line.find_first_not_of(" \t");
+            if(start == std::string::npos || line.compare(start, 8, "#include") != 0)
+            {
+                result << line << '\n';
+                continue;
+            }
+            std::string::size_type open = line.find('"', start);
+            std::string::size_type close = open == std::string::npos ? open : line.find('"', open + 1);
+            if(close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE in " << path << ": " << line << std::endl;
+                continue;
+            }
+            std::string includePath = directory + line.substr(open + 1, close - open - 1);
+            if(std::find(included.begin(), included.end(), includePath) == included.end())
+            {
+                included.push_back(includePath);
+                std::string includeCode = readFileContents(includePath);
+                if(includeCode.empty())
+                    std::cout << "ERROR::SHADER::INCLUDE_NOT_SUCCESFULLY_READ: " << includePath << std::endl;
+                result << "#line 1 " << included.size() << '\n';
+                result << resolveIncludes(includeCode, includePath, included);
+            }
+            result << "#line " << lineNumber + 1 << ' ' << source << '\n';
+        }
+        return result.str();
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,201 @@
+//
+// Exposure that follows the average scene luminance, computed and adapted on the GPU.
+//
+
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/Error.h>
+
+namespace rg {
+
+// measure() draws the log luminance of the scene into a small square texture and lets
+// glGenerateMipmap average it down to one texel, which is the log of the geometric mean of
+// the scene's luminance: a few very bright pixels such as the sun don't dominate it the
+// way they would an arithmetic mean. adapt() moves the adapted luminance, a 1x1 texture
+// kept from frame to frame, towards that value with an exponential falloff, faster when
+// the scene gets brighter than when it gets darker. hdr.fs reads the texel directly, so the
+// value never has to come back to the CPU. It still does, for display: every adapt() copies
+// the texel into one of a ring of pixel buffers and fences it, and the oldest buffer is
+// mapped once its fence has signalled, so averageLuminance() lags a few frames behind
+// without ever stalling the pipeline.
+class AutoExposure {
+public:
+    // adaptation rates per second
+    float speedUp = 3.0f;
+    float speedDown = 1.0f;
+    // range the measured luminance is clamped to before adapting
+    float minLuminance = 0.02f;
+    float maxLuminance = 20.0f;
+
+    // luminance that gets an exposure of 1, hdr.fs divides it by the adapted luminance
+    float keyValue = 0.18f;
+
+    // adapted luminance before the first frame, gives the same exposure of 1
+    static constexpr float InitialLuminance = 0.18f;
+
+    explicit AutoExposure(int size = 256)
+            : m_Size(size) {
+        m_Levels = 1;
+        while ((size >>= 1) > 0)
+            m_Levels++;
+
+        glGenTextures(1, &m_Luminance);
+        glBindTexture(GL_TEXTURE_2D, m_Luminance);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, m_Size, m_Size, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        m_LuminanceFramebuffer = createFramebuffer(m_Luminance);
+
+        const float initial = InitialLuminance;
+        for (int i = 0; i < 2; i++) {
+            glGenTextures(1, &m_Adapted[i]);
+            glBindTexture(GL_TEXTURE_2D, m_Adapted[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &initial);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            m_AdaptedFramebuffers[i] = createFramebuffer(m_Adapted[i]);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenBuffers(ReadbackCount, m_ReadbackBuffers);
+        for (unsigned int buffer : m_ReadbackBuffers) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    ~AutoExposure() {
+        for (GLsync fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        glDeleteBuffers(ReadbackCount, m_ReadbackBuffers);
+        glDeleteFramebuffers(2, m_AdaptedFramebuffers);
+        glDeleteFramebuffers(1, &m_LuminanceFramebuffer);
+        glDeleteTextures(2, m_Adapted);
+        glDeleteTextures(1, &m_Luminance);
+    }
+
+    AutoExposure(const AutoExposure &) = delete;
+    AutoExposure &operator=(const AutoExposure &) = delete;
+
+    // Where measure() and adapt() draw, for the frame graph to bind.
+    unsigned int luminanceFramebuffer() const { return m_LuminanceFramebuffer; }
+    unsigned int adaptFramebuffer() const { return m_AdaptedFramebuffers[1 - m_Current]; }
+    int size() const { return m_Size; }
+
+    // Draws the log luminance of the part of scene given by sceneScale into the bound
+    // luminance framebuffer, then reduces it.
+    void measure(Shader &luminance, unsigned int scene, const glm::vec2 &sceneScale, unsigned int quadVAO) {
+        luminance.use();
+        luminance.setVec2("uvScale", sceneScale);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, scene);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, m_Luminance);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    // Moves the adapted luminance deltaTime seconds towards the last measurement. Draws into
+    // adaptFramebuffer(), which becomes adaptedTexture() afterwards.
+    void adapt(Shader &adaptation, float deltaTime, unsigned int quadVAO) {
+        collectReadback();
+        adaptation.use();
+        adaptation.setFloat("lastLevel", (float) (m_Levels - 1));
+        adaptation.setFloat("deltaTime", deltaTime);
+        adaptation.setFloat("speedUp", speedUp);
+        adaptation.setFloat("speedDown", speedDown);
+        adaptation.setVec2("luminanceRange", minLuminance, maxLuminance);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_Luminance);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_Adapted[m_Current]);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        m_Current = 1 - m_Current;
+        queueReadback();
+    }
+
+    unsigned int adaptedTexture() const { return m_Adapted[m_Current]; }
+
+    // the adapted luminance as of a few frames ago
+    float averageLuminance() const { return m_Readback; }
+
+private:
+    static const int ReadbackCount = 3;
+
+    int m_Size;
+    int m_Levels;
+    unsigned int m_Luminance = 0;
+    unsigned int m_LuminanceFramebuffer = 0;
+    unsigned int m_Adapted[2] = {};
+    unsigned int m_AdaptedFramebuffers[2] = {};
+    int m_Current = 0;
+
+    unsigned int m_ReadbackBuffers[ReadbackCount] = {};
+    GLsync m_Fences[ReadbackCount] = {};
+    int m_NextReadback = 0;
+    float m_Readback = InitialLuminance;
+
+    static unsigned int createFramebuffer(unsigned int texture) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            ASSERT(false, "Auto exposure framebuffer not complete!");
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return framebuffer;
+    }
+
+    // Copies the texel just written into the next buffer of the ring, skipped while that
+    // buffer's previous copy hasn't been collected.
+    void queueReadback() {
+        if (m_Fences[m_NextReadback])
+            return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_AdaptedFramebuffers[m_Current]);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_ReadbackBuffers[m_NextReadback]);
+        glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_Fences[m_NextReadback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_NextReadback = (m_NextReadback + 1) % ReadbackCount;
+    }
+
+    // Maps every buffer whose copy has finished, oldest first; a zero timeout only polls.
+    void collectReadback() {
+        for (int i = 0; i < ReadbackCount; i++) {
+            int slot = (m_NextReadback + i) % ReadbackCount;
+            if (!m_Fences[slot])
+                continue;
+            GLenum status = glClientWaitSync(m_Fences[slot], 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(m_Fences[slot]);
+            m_Fences[slot] = nullptr;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_ReadbackBuffers[slot]);
+            void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), GL_MAP_READ_BIT);
+            if (data) {
+                m_Readback = *(const float *) data;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
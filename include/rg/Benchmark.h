@@ -0,0 +1,51 @@
+//
+// Small helpers shared by the CPU benchmarks started with --bench <name>.
+//
+
+#ifndef PROJECT_BASE_BENCHMARK_H
+#define PROJECT_BASE_BENCHMARK_H
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+class Stopwatch {
+    std::chrono::steady_clock::time_point m_Start;
+public:
+    Stopwatch() : m_Start(std::chrono::steady_clock::now()) {}
+
+    void reset() {
+        m_Start = std::chrono::steady_clock::now();
+    }
+
+    double elapsedMilliseconds() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+    }
+};
+
+// Prints fixed-width rows so the results of different runs line up in a terminal.
+class BenchmarkTable {
+    std::vector<std::string> m_Columns;
+public:
+    explicit BenchmarkTable(const std::vector<std::string> &columns) : m_Columns(columns) {
+        for (const std::string &c : m_Columns)
+            std::cout << std::setw(14) << c;
+        std::cout << '\n';
+    }
+
+    template<typename... Values>
+    void row(const Values &... values) {
+        std::cout << std::fixed << std::setprecision(3);
+        int expand[] = {0, ((std::cout << std::setw(14) << values), 0)...};
+        (void)expand;
+        std::cout << std::endl;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BENCHMARK_H
@@ -0,0 +1,138 @@
+//
+// Bloom from a downsample/upsample chain over a pyramid of half resolution targets.
+//
+
+#ifndef PROJECT_BASE_BLOOM_H
+#define PROJECT_BASE_BLOOM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/RenderTargetPool.h>
+#include <algorithm>
+#include <vector>
+
+namespace rg {
+
+// The first downsample reads the HDR scene and drops everything below the brightness
+// threshold into mip 0 (half resolution), so no scene shader has to write a separate bright
+// color target. From there the chain goes down through progressively smaller targets, then
+// every level is upsampled with a tent filter and added onto the level above it. Each pass
+// reads a handful of bilinear taps from a target a quarter the size of the previous one, so
+// the whole chain writes about 2/3 of a full resolution frame instead of one full frame per
+// blur pass.
+class Bloom {
+public:
+    // luminance a pixel needs to contribute to bloom
+    float threshold = 1.0f;
+    // radius of the upsample tent filter, in texels of the level being read
+    float filterRadius = 1.0f;
+    // part of the scene texture that holds the image, less than 1 with dynamic resolution
+    glm::vec2 sourceScale = glm::vec2(1.0f);
+    // level that gets the separable Gaussian when render() is given a blur shader
+    int blurLevel = 2;
+
+    explicit Bloom(int mipCount = 6)
+            : m_MipCount(mipCount) {}
+
+    // Runs the chain on the scene target and leaves the result in mip0, a target half the
+    // scene's size (see mip0Desc) that belongs to the caller. With a blur shader, blurLevel
+    // gets a horizontal and a vertical pass of it before the upsample. The smaller levels
+    // come from the pool and go back as soon as the level above has read them.
+    // Blending and the viewport are restored afterwards.
+    void render(RenderTargetPool &pool, RenderTargetPool::Target scene, RenderTargetPool::Target mip0,
+                Shader &downsample, Shader &upsample, unsigned int quadVAO, Shader *blur = nullptr) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        GLint blendSrc, blendDst;
+        glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrc);
+        glGetIntegerv(GL_BLEND_DST_RGB, &blendDst);
+
+        std::vector<RenderTargetPool::Target> mips(1, mip0);
+        int w = pool.desc(mip0).width, h = pool.desc(mip0).height;
+        for (int i = 1; i < m_MipCount && (w > 1 || h > 1); i++) {
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+            mips.push_back(pool.acquire(RenderTargetDesc(w, h, GL_R11F_G11F_B10F)));
+        }
+        m_Levels = (int) mips.size();
+
+        glBindVertexArray(quadVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDisable(GL_BLEND);
+        downsample.use();
+        downsample.setFloat("threshold", threshold);
+        RenderTargetPool::Target source = scene;
+        for (RenderTargetPool::Target mip : mips) {
+            const RenderTargetDesc &from = pool.desc(source);
+            const RenderTargetDesc &to = pool.desc(mip);
+            glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(mip));
+            glViewport(0, 0, to.width, to.height);
+            downsample.setVec2("texelSize", 1.0f / (float) from.width, 1.0f / (float) from.height);
+            bool brightPass = source == scene;
+            downsample.setBool("brightPass", brightPass);
+            downsample.setVec2("uvScale", brightPass ? sourceScale : glm::vec2(1.0f));
+            downsample.setVec2("uvMax", brightPass ? sourceScale - 0.5f / glm::vec2(from.width, from.height) : glm::vec2(1.0f));
+            glBindTexture(GL_TEXTURE_2D, pool.texture(source));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            source = mip;
+        }
+
+        if (blur) {
+            // the horizontal pass writes into a scratch target, the vertical one back into the level
+            RenderTargetPool::Target level = mips[std::min(blurLevel, (int) mips.size() - 1)];
+            RenderTargetDesc desc = pool.desc(level);
+            RenderTargetPool::Target scratch = pool.acquire(desc);
+            blur->use();
+            glViewport(0, 0, desc.width, desc.height);
+            blur->setVec2("texelSize", 1.0f / (float) desc.width, 1.0f / (float) desc.height);
+            glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(scratch));
+            blur->setBool("horizontal", true);
+            glBindTexture(GL_TEXTURE_2D, pool.texture(level));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(level));
+            blur->setBool("horizontal", false);
+            glBindTexture(GL_TEXTURE_2D, pool.texture(scratch));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            pool.release(scratch);
+        }
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        upsample.use();
+        for (int i = (int) mips.size() - 1; i > 0; i--) {
+            const RenderTargetDesc &from = pool.desc(mips[i]);
+            const RenderTargetDesc &to = pool.desc(mips[i - 1]);
+            glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(mips[i - 1]));
+            glViewport(0, 0, to.width, to.height);
+            upsample.setVec2("texelSize", filterRadius / (float) from.width, filterRadius / (float) from.height);
+            glBindTexture(GL_TEXTURE_2D, pool.texture(mips[i]));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            pool.release(mips[i]);
+        }
+        glBindVertexArray(0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBlendFunc(blendSrc, blendDst);
+        if (!blend)
+            glDisable(GL_BLEND);
+    }
+
+    static RenderTargetDesc mip0Desc(const RenderTargetDesc &scene) {
+        return RenderTargetDesc(std::max(1, scene.width / 2), std::max(1, scene.height / 2), GL_R11F_G11F_B10F);
+    }
+
+    // levels used by the last render(), the result is the sum of all of them
+    int mipCount() const { return m_Levels; }
+
+private:
+    int m_MipCount;
+    int m_Levels = 1;
+};
+
+}
+
+#endif //PROJECT_BASE_BLOOM_H
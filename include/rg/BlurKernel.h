@@ -0,0 +1,129 @@
+//
+// Separable Gaussian kernels that use bilinear filtering to fetch two texels at once.
+//
+
+#ifndef PROJECT_BASE_BLURKERNEL_H
+#define PROJECT_BASE_BLURKERNEL_H
+
+#include <rg/Benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// One side of a symmetric 1D kernel: tap 0 is the center, every other tap is fetched at
+// +offset and -offset. Offsets are in texels and may fall between texel centers, where the
+// sampler's linear filter blends two neighbours with exactly the ratio of their weights.
+struct BlurKernel {
+    std::vector<float> offsets;
+    std::vector<float> weights;
+
+    // texture fetches for one pass of the separable blur
+    int fetches() const { return (int) offsets.size() * 2 - 1; }
+
+    // Plain Gaussian, one tap per texel at integer offsets 0..radius.
+    static BlurKernel discrete(int radius, float sigma) {
+        BlurKernel kernel;
+        float sum = 0.0f;
+        float twoSigmaSquared = std::max(2.0f * sigma * sigma, 1e-6f);
+        for (int i = 0; i <= radius; i++) {
+            float w = std::exp(-(float) (i * i) / twoSigmaSquared);
+            kernel.offsets.push_back((float) i);
+            kernel.weights.push_back(w);
+            sum += i == 0 ? w : 2.0f * w;
+        }
+        for (float &w : kernel.weights)
+            w /= sum;
+        return kernel;
+    }
+
+    // Same filter as discrete(), with texels 2k-1 and 2k merged into a single tap placed at
+    // their weighted average position. Fetches drop from 2r+1 to r+1 (rounded up to odd).
+    static BlurKernel linear(int radius, float sigma) {
+        BlurKernel d = discrete(radius, sigma);
+        BlurKernel kernel;
+        kernel.offsets.push_back(0.0f);
+        kernel.weights.push_back(d.weights[0]);
+        for (int i = 1; i <= radius; i += 2) {
+            float w1 = d.weights[i];
+            float w2 = i + 1 <= radius ? d.weights[i + 1] : 0.0f;
+            float w = w1 + w2;
+            kernel.offsets.push_back(((float) i * w1 + (float) (i + 1) * w2) / w);
+            kernel.weights.push_back(w);
+        }
+        return kernel;
+    }
+
+    // GLSL constants for Shader's prelude: KERNEL_TAPS, kernelOffsets[] and kernelWeights[].
+    std::string glslConstants() const {
+        std::ostringstream glsl;
+        glsl.precision(9);
+        glsl << "#define KERNEL_TAPS " << offsets.size() << "\n";
+        glsl << "const float kernelOffsets[KERNEL_TAPS] = float[](";
+        for (unsigned int i = 0; i < offsets.size(); i++)
+            glsl << (i ? ", " : "") << std::fixed << offsets[i];
+        glsl << ");\nconst float kernelWeights[KERNEL_TAPS] = float[](";
+        for (unsigned int i = 0; i < weights.size(); i++)
+            glsl << (i ? ", " : "") << std::fixed << weights[i];
+        glsl << ");\n";
+        return glsl.str();
+    }
+};
+
+// Applies a kernel along one row the way the GPU would: fractional offsets are
+// linearly interpolated between the two neighbouring texels, edges are clamped.
+inline void convolveRow(const std::vector<float> &row, const BlurKernel &kernel, std::vector<float> &out) {
+    const int n = (int) row.size();
+    out.resize(n);
+    auto sample = [&row, n](float x) {
+        float base = std::floor(x);
+        float t = x - base;
+        int a = std::min(std::max((int) base, 0), n - 1);
+        int b = std::min(std::max((int) base + 1, 0), n - 1);
+        return row[a] * (1.0f - t) + row[b] * t;
+    };
+    for (int x = 0; x < n; x++) {
+        float sum = row[x] * kernel.weights[0];
+        for (unsigned int i = 1; i < kernel.offsets.size(); i++)
+            sum += (sample((float) x + kernel.offsets[i]) + sample((float) x - kernel.offsets[i])) * kernel.weights[i];
+        out[x] = sum;
+    }
+}
+
+// Fetch counts of both kernels per radius, what a horizontal + vertical blur of a full 1080p
+// frame would cost with each, and the largest difference between their results on a row
+// of noise, which should stay at float rounding level.
+inline void benchmarkBlurKernel() {
+    const int width = 1920, height = 1080;
+    std::vector<float> row(width);
+    srand(7);
+    for (float &v : row)
+        v = (float) (rand() % 1000) / 100.0f;
+    std::vector<float> discreteResult, linearResult;
+
+    std::cout << "Separable Gaussian, sigma = radius / 2. Fetches are per pass and pixel, M columns are\n"
+              << "millions of fetches for the horizontal + vertical pass over " << width << "x" << height << "\n";
+    BenchmarkTable table({"radius", "fetches", "linear", "saved %", "M discrete", "M linear", "max error"});
+    for (int radius : {2, 4, 6, 8, 12, 16}) {
+        float sigma = (float) radius / 2.0f;
+        BlurKernel d = BlurKernel::discrete(radius, sigma);
+        BlurKernel l = BlurKernel::linear(radius, sigma);
+        convolveRow(row, d, discreteResult);
+        convolveRow(row, l, linearResult);
+
+        float maxError = 0.0f;
+        for (int x = radius + 1; x < width - radius - 1; x++)
+            maxError = std::max(maxError, std::abs(discreteResult[x] - linearResult[x]));
+        double pixels = 2.0 * width * height / 1e6;
+        table.row(radius, d.fetches(), l.fetches(), 100.0 * (1.0 - (double) l.fetches() / d.fetches()),
+                  pixels * d.fetches(), pixels * l.fetches(), maxError);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_BLURKERNEL_H
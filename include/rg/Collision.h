@@ -0,0 +1,518 @@
+//
+// A uniform spatial hash grid over moving spheres, for the rocks' collisions with each other and the shuttle.
+//
+
+#ifndef PROJECT_BASE_COLLISION_H
+#define PROJECT_BASE_COLLISION_H
+
+#include <glm/glm.hpp>
+#include <rg/Benchmark.h>
+#include <rg/JobSystem.h>
+#include <rg/RadixSort.h>
+#include <rg/SpatialIndex.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Two shapes overlapping by depth along normal, the unit direction from a to b.
+struct Contact {
+    unsigned int a, b;
+    glm::vec3 normal;
+    float depth;
+};
+
+// The spheres go into the cells of a uniform grid by their centers. Cells are at least as large
+// as the largest sphere is across, so two spheres can only touch when their cells are
+// neighbours: findPairs() tests the spheres of a cell against each other and against the
+// spheres of its 13 neighbours on one side, which tests every pair once.
+//
+// A cell's key, its hash, is its index in the grid over the bounds of the spheres, with the
+// axis of the fewest cells fastest. build() sorts the spheres by key and keeps only the
+// occupied cells, as a list of keys in order and where each cell's spheres start, so the
+// memory goes with the spheres and not the grid. Keys run along rows, so the 13 neighbours
+// after a cell are its next cell in the row and four runs of three cells in the rows above
+// it, each a range of the list; runs close in key order are merged. Going through the cells
+// in order, the ranges move forward in step, and findPairs() finds them by moving a cursor
+// per run instead of looking anything up.
+//
+// build() is meant to run every frame on bodies that moved. Bounds and keys are computed on
+// the jobs, and the bodies sorted by key with a RadixSorter on the jobs. Within a cell the
+// bodies stay in the order they came in, so the contacts come out in the same order whatever
+// the thread count.
+class SpatialHashGrid {
+public:
+    // b of the contacts collide() finds
+    static const unsigned int Box = 0xFFFFFFFFu;
+
+    // 0 sizes the cells to the largest sphere
+    float cellSize = 0.0f;
+
+    struct Stats {
+        unsigned int bodies = 0;
+        unsigned int cells = 0;          // occupied
+        unsigned int maxPerCell = 0;     // of the last findPairs()
+        float cellSize = 0.0f;
+        uint64_t tests = 0;              // sphere tests of the last findPairs()
+        unsigned int pairs = 0;
+        unsigned int boxTests = 0;       // sphere tests of collide() since the last build()
+        unsigned int boxContacts = 0;
+        float buildMilliseconds = 0.0f;
+        float pairMilliseconds = 0.0f;
+    };
+
+    void build(const std::vector<Sphere> &bodies, JobSystem *jobs = nullptr) {
+        Stopwatch sw;
+        const unsigned int count = (unsigned int) bodies.size();
+        m_Keys.resize(count);
+        // after the spheres, ones no test finds, for findPairs() to read past the last cell
+        for (std::vector<float> *array : {&m_X, &m_Y, &m_Z, &m_Radius})
+            array->assign(count + Window, std::numeric_limits<float>::quiet_NaN());
+        m_Bodies.resize(count);
+        m_Stats = Stats();
+        m_Stats.bodies = count;
+        m_Size = glm::ivec3(0);
+        m_CellKeys.assign(Sentinels, uint32_t(Empty));
+        m_CellStarts.assign(1, 0u);
+        if (count == 0)
+            return;
+
+        // bounds and the cell size, from the largest radius
+        glm::vec3 lows[Chunks], highs[Chunks];
+        float maxRadii[Chunks];
+        std::fill(lows, lows + Chunks, glm::vec3(INFINITY));
+        std::fill(highs, highs + Chunks, glm::vec3(-INFINITY));
+        std::fill(maxRadii, maxRadii + Chunks, 0.0f);
+        forChunks(jobs, count, Chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            glm::vec3 chunkLow = lows[c], chunkHigh = highs[c];
+            float chunkRadius = 0.0f;
+            for (unsigned int i = begin; i < end; i++) {
+                chunkLow = glm::min(chunkLow, bodies[i].center);
+                chunkHigh = glm::max(chunkHigh, bodies[i].center);
+                chunkRadius = std::max(chunkRadius, bodies[i].radius);
+            }
+            lows[c] = chunkLow;
+            highs[c] = chunkHigh;
+            maxRadii[c] = chunkRadius;
+        });
+        glm::vec3 low = lows[0], high = highs[0];
+        m_MaxRadius = maxRadii[0];
+        for (unsigned int c = 1; c < Chunks; c++) {
+            low = glm::min(low, lows[c]);
+            high = glm::max(high, highs[c]);
+            m_MaxRadius = std::max(m_MaxRadius, maxRadii[c]);
+        }
+        m_CellSize = std::max(cellSize, 2.0f * m_MaxRadius);
+        if (m_CellSize <= 0.0f)
+            m_CellSize = 1.0f;
+        // A ring of empty cells around the occupied ones, so the neighbours of every occupied
+        // cell have keys of their own. Spheres spread too far for 32-bit keys get larger cells.
+        uint64_t gridCells;
+        for (;;) {
+            m_Inverse = 1.0f / m_CellSize;
+            m_Origin = glm::ivec3(glm::floor(low * m_Inverse)) - glm::ivec3(1);
+            m_Size = glm::ivec3(glm::floor(high * m_Inverse)) - m_Origin + glm::ivec3(2);
+            gridCells = (uint64_t) m_Size.x * m_Size.y * m_Size.z;
+            if (gridCells < Empty)
+                break;
+            m_CellSize *= 2.0f;
+        }
+        m_Stats.cellSize = m_CellSize;
+        // the axis with the fewest cells first, the neighbours are the closest in key order
+        m_Axes[0] = m_Size.x <= m_Size.y && m_Size.x <= m_Size.z ? 0 : m_Size.y <= m_Size.z ? 1 : 2;
+        m_Axes[1] = m_Axes[0] == 0 ? 1 : 0;
+        m_Axes[2] = m_Axes[0] == 2 ? 1 : 2;
+        m_Strides[m_Axes[0]] = 1;
+        m_Strides[m_Axes[1]] = (uint32_t) m_Size[m_Axes[0]];
+        m_Strides[m_Axes[2]] = (uint32_t) m_Size[m_Axes[0]] * (uint32_t) m_Size[m_Axes[1]];
+
+        // within the ring the cell coordinates are positive, and truncating them is flooring
+        const glm::vec3 origin(m_Origin);
+        forChunks(jobs, count, Chunks, [&](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                m_Keys[i] = {key(glm::ivec3(bodies[i].center * m_Inverse - origin)), i};
+        });
+        unsigned int keyBits = 0;
+        while (keyBits < 32 && (uint64_t) 1 << keyBits < gridCells)
+            keyBits++;
+        m_Sorter.sort(m_Keys, keyBits, [](const Key &k) { return k.cell; }, jobs);
+
+        // the spheres in key order, and every occupied cell where its first one is
+        unsigned int firstCells[Chunks + 1];
+        forChunks(jobs, count, Chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            unsigned int cells = 0;
+            for (unsigned int s = begin; s < end; s++) {
+                const Sphere &body = bodies[m_Keys[s].body];
+                m_X[s] = body.center.x;
+                m_Y[s] = body.center.y;
+                m_Z[s] = body.center.z;
+                m_Radius[s] = body.radius;
+                m_Bodies[s] = m_Keys[s].body;
+                if (s == 0 || m_Keys[s - 1].cell != m_Keys[s].cell)
+                    cells++;
+            }
+            firstCells[c + 1] = cells;
+        });
+        firstCells[0] = 0;
+        for (unsigned int c = 0; c < Chunks; c++)
+            firstCells[c + 1] += firstCells[c];
+        const unsigned int cells = firstCells[Chunks];
+        m_CellKeys.resize(cells + Sentinels);
+        std::fill(m_CellKeys.begin() + cells, m_CellKeys.end(), uint32_t(Empty));
+        m_CellStarts.resize(cells + 1);
+        forChunks(jobs, count, Chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            unsigned int cell = firstCells[c];
+            for (unsigned int s = begin; s < end; s++) {
+                if (s == 0 || m_Keys[s - 1].cell != m_Keys[s].cell) {
+                    m_CellKeys[cell] = m_Keys[s].cell;
+                    m_CellStarts[cell] = s;
+                    cell++;
+                }
+            }
+        });
+        m_CellStarts[cells] = count;
+        m_Stats.cells = cells;
+        m_Stats.buildMilliseconds = (float) sw.elapsedMilliseconds();
+    }
+
+    // Every pair of overlapping spheres, a the lower body index.
+    void findPairs(std::vector<Contact> &contacts, JobSystem *jobs = nullptr) {
+        Stopwatch sw;
+        contacts.clear();
+        const unsigned int cells = m_Stats.cells;
+        // The 13 neighbours after a cell: the next one along the first axis, three in the next
+        // row and three rows of three in the next slice, five runs of keys. Runs with only a
+        // few keys between them are merged, the cells in between cost fewer tests than another
+        // run costs to find.
+        const uint32_t row = m_Strides[m_Axes[1]], slice = m_Strides[m_Axes[2]];
+        const uint32_t runs[5][2] = {{1, 2}, {row - 1, row + 2}, {slice - row - 1, slice - row + 2},
+                                     {slice - 1, slice + 2}, {slice + row - 1, slice + row + 2}};
+        uint32_t lows[5], highs[5];
+        unsigned int ranges = 0;
+        for (const uint32_t *run : runs) {
+            if (ranges > 0 && run[0] - highs[ranges - 1] <= MaxGap)
+                highs[ranges - 1] = run[1];
+            else {
+                lows[ranges] = run[0];
+                highs[ranges] = run[1];
+                ranges++;
+            }
+        }
+        uint64_t tests[Chunks] = {};
+        unsigned int largest[Chunks] = {};
+        forChunks(jobs, cells, Chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            std::vector<Contact> &found = m_ChunkContacts[c];
+            found.clear();
+            if (begin == end)
+                return;
+            const uint32_t *keys = m_CellKeys.data();
+            const unsigned int *starts = m_CellStarts.data();
+            // Moves a cursor to the first cell with a key of at least bound, mostly without
+            // branching on the keys: the cells are mostly empty, and the steps between keys too
+            // irregular to predict. Cursors move a cell or two a step, the sentinel stops them.
+            auto advance = [keys](unsigned int cursor, uint32_t bound) {
+                cursor += keys[cursor] < bound;
+                cursor += keys[cursor] < bound;
+                while (keys[cursor] < bound)
+                    cursor++;
+                return cursor;
+            };
+            // where the ranges of the chunk's first cell begin and end, or would
+            unsigned int fromCells[5], toCells[5];
+            for (unsigned int r = 0; r < ranges; r++) {
+                fromCells[r] = (unsigned int) (std::lower_bound(keys + begin, keys + cells, keys[begin] + lows[r]) - keys);
+                toCells[r] = (unsigned int) (std::lower_bound(keys + begin, keys + cells, keys[begin] + highs[r]) - keys);
+            }
+            // every tested pair is written and only the overlapping ones kept, without a branch
+            // on the test; their contacts are worked out after
+            std::vector<Candidate> &candidates = m_ChunkCandidates[c];
+            unsigned int used = 0;
+            uint64_t local = 0;
+            unsigned int chunkLargest = 0;
+            for (unsigned int cell = begin; cell < end; cell++) {
+                const uint32_t cellKey = keys[cell];
+                const unsigned int first = starts[cell], last = starts[cell + 1];
+                chunkLargest = std::max(chunkLargest, last - first);
+                // the first range starts right after the cell, so the rest of the cell and it are one
+                unsigned int from[5], to[5];
+                toCells[0] = advance(toCells[0], cellKey + highs[0]);
+                to[0] = starts[toCells[0]];
+                for (unsigned int r = 1; r < ranges; r++) {
+                    fromCells[r] = advance(fromCells[r], cellKey + lows[r]);
+                    toCells[r] = advance(toCells[r], cellKey + highs[r]);
+                    from[r] = starts[fromCells[r]];
+                    to[r] = starts[toCells[r]];
+                }
+                for (unsigned int i = first; i < last; i++) {
+                    from[0] = i + 1;
+                    // the first Window spheres of a range at once, masked to the range
+                    for (unsigned int r = 0; r < ranges; r++) {
+                        const unsigned int j = from[r], n = to[r] - j;
+                        if (used + Window > candidates.size())
+                            candidates.resize(2 * candidates.size() + Window);
+                        const unsigned int hits = overlapMask(i, j) & ((1u << std::min(n, Window)) - 1);
+                        for (unsigned int k = 0; k < Window; k++) {
+                            candidates[used] = {i, j + k};
+                            used += (hits >> k) & 1u;
+                        }
+                        for (unsigned int k = Window; k < n; k++) {
+                            if (overlaps(i, j + k)) {
+                                if (used == candidates.size())
+                                    candidates.resize(2 * candidates.size());
+                                candidates[used++] = {i, j + k};
+                            }
+                        }
+                        local += n;
+                    }
+                }
+            }
+            found.resize(used);
+            for (unsigned int k = 0; k < used; k++)
+                found[k] = contact(candidates[k].i, candidates[k].j);
+            tests[c] = local;
+            largest[c] = chunkLargest;
+        });
+        for (unsigned int c = 0; c < Chunks; c++) {
+            contacts.insert(contacts.end(), m_ChunkContacts[c].begin(), m_ChunkContacts[c].end());
+            m_Stats.tests += tests[c];
+            m_Stats.maxPerCell = std::max(m_Stats.maxPerCell, largest[c]);
+        }
+        m_Stats.pairs = (unsigned int) contacts.size();
+        m_Stats.pairMilliseconds = (float) sw.elapsedMilliseconds();
+    }
+
+    // Appends the spheres overlapping box, each with b = Box and the normal pointing into the box.
+    void collide(const AABB &box, std::vector<Contact> &contacts) {
+        if (m_Stats.bodies == 0)
+            return;
+        // the cells the spheres reaching into the box can be in, within the grid
+        const glm::vec3 origin(m_Origin);
+        glm::ivec3 low = glm::max(glm::ivec3(glm::floor((box.min - glm::vec3(m_MaxRadius)) * m_Inverse - origin)),
+                                  glm::ivec3(0));
+        glm::ivec3 high = glm::min(glm::ivec3(glm::floor((box.max + glm::vec3(m_MaxRadius)) * m_Inverse - origin)),
+                                   m_Size - glm::ivec3(1));
+        if (low.x > high.x || low.y > high.y || low.z > high.z)
+            return;
+        const unsigned int cells = m_Stats.cells;
+        const int a0 = m_Axes[0], a1 = m_Axes[1], a2 = m_Axes[2];
+        if ((uint64_t) (high[a1] - low[a1] + 1) * (high[a2] - low[a2] + 1) > cells) {
+            // a box this large is quicker checked against every sphere
+            for (unsigned int i = 0; i < m_Stats.bodies; i++)
+                testBox(i, box, contacts);
+            return;
+        }
+        // a row of cells along the first axis is a range of keys
+        for (int c2 = low[a2]; c2 <= high[a2]; c2++) {
+            for (int c1 = low[a1]; c1 <= high[a1]; c1++) {
+                glm::ivec3 rowCell = low;
+                rowCell[a1] = c1;
+                rowCell[a2] = c2;
+                const uint32_t firstKey = key(rowCell);
+                rowCell[a0] = high[a0];
+                const uint32_t lastKey = key(rowCell);
+                unsigned int cell = (unsigned int) (std::lower_bound(m_CellKeys.begin(), m_CellKeys.begin() + cells, firstKey) -
+                                                    m_CellKeys.begin());
+                for (; m_CellKeys[cell] <= lastKey; cell++) {
+                    for (unsigned int i = m_CellStarts[cell]; i < m_CellStarts[cell + 1]; i++)
+                        testBox(i, box, contacts);
+                }
+            }
+        }
+    }
+
+    const Stats &stats() const { return m_Stats; }
+
+private:
+    struct Key {
+        uint32_t cell;
+        uint32_t body;
+    };
+
+    // two spheres by their places in key order
+    struct Candidate {
+        unsigned int i, j;
+    };
+
+    static const unsigned int Chunks = 64;
+    // after the last cell, a key larger than any cell's
+    static const unsigned int Sentinels = 1;
+    static const uint32_t Empty = 0xFFFFFFFFu;
+    static const unsigned int Window = 4;
+    static const uint32_t MaxGap = 4;
+
+    std::vector<Key> m_Keys;
+    RadixSorter<Key> m_Sorter;
+    std::vector<float> m_X, m_Y, m_Z, m_Radius;   // the spheres in key order
+    std::vector<unsigned int> m_Bodies;           // of every sphere
+    std::vector<uint32_t> m_CellKeys;      // of the occupied cells, ascending, then the sentinels
+    std::vector<unsigned int> m_CellStarts;   // entries of cell c are m_CellStarts[c] to m_CellStarts[c + 1]
+    std::vector<Contact> m_ChunkContacts[Chunks];
+    std::vector<Candidate> m_ChunkCandidates[Chunks];
+    glm::ivec3 m_Origin = glm::ivec3(0);   // the grid's first cell
+    glm::ivec3 m_Size = glm::ivec3(0);     // in cells
+    int m_Axes[3] = {0, 1, 2};             // fastest changing in the key first
+    uint32_t m_Strides[3] = {1, 1, 1};     // of the keys along x, y and z
+    float m_CellSize = 1.0f;
+    float m_Inverse = 1.0f;
+    float m_MaxRadius = 0.0f;
+    Stats m_Stats;
+
+    // of a cell relative to the grid's origin; offsets between cells add up the same way
+    uint32_t key(const glm::ivec3 &cell) const {
+        return (uint32_t) ((int64_t) cell.x * m_Strides[0] + (int64_t) cell.y * m_Strides[1] + (int64_t) cell.z * m_Strides[2]);
+    }
+
+    bool overlaps(unsigned int i, unsigned int j) const {
+        float dx = m_X[j] - m_X[i], dy = m_Y[j] - m_Y[i], dz = m_Z[j] - m_Z[i];
+        float reach = m_Radius[i] + m_Radius[j];
+        return dx * dx + dy * dy + dz * dz < reach * reach;
+    }
+
+    // bit k set where sphere i overlaps sphere j + k, for the Window spheres from j
+    unsigned int overlapMask(unsigned int i, unsigned int j) const {
+#if defined(__SSE2__)
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&m_X[j]), _mm_set1_ps(m_X[i]));
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&m_Y[j]), _mm_set1_ps(m_Y[i]));
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(&m_Z[j]), _mm_set1_ps(m_Z[i]));
+        __m128 reach = _mm_add_ps(_mm_loadu_ps(&m_Radius[j]), _mm_set1_ps(m_Radius[i]));
+        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        return (unsigned int) _mm_movemask_ps(_mm_cmplt_ps(distance2, _mm_mul_ps(reach, reach)));
+#else
+        unsigned int mask = 0;
+        for (unsigned int k = 0; k < Window; k++)
+            mask |= overlaps(i, j + k) ? 1u << k : 0u;
+        return mask;
+#endif
+    }
+
+    Contact contact(unsigned int i, unsigned int j) const {
+        glm::vec3 d(m_X[j] - m_X[i], m_Y[j] - m_Y[i], m_Z[j] - m_Z[i]);
+        float distance = glm::length(d);
+        float depth = m_Radius[i] + m_Radius[j] - distance;
+        // spheres right on top of each other are pushed apart along y
+        glm::vec3 normal = distance > 1e-6f ? d / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+        // selected rather than branched on, which of the two bodies is the lower is a coin toss
+        const bool ordered = m_Bodies[i] < m_Bodies[j];
+        return {ordered ? m_Bodies[i] : m_Bodies[j], ordered ? m_Bodies[j] : m_Bodies[i], ordered ? normal : -normal, depth};
+    }
+
+    void testBox(unsigned int i, const AABB &box, std::vector<Contact> &contacts) {
+        m_Stats.boxTests++;
+        const glm::vec3 center(m_X[i], m_Y[i], m_Z[i]);
+        const float radius = m_Radius[i];
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 d = closest - center;
+        float distance2 = glm::dot(d, d);
+        if (distance2 > radius * radius)
+            return;
+        glm::vec3 normal;
+        float depth;
+        if (distance2 > 1e-12f) {
+            float distance = std::sqrt(distance2);
+            normal = d / distance;
+            depth = radius - distance;
+        }
+        else {
+            // the center is inside, out through the nearest face
+            glm::vec3 toMin = center - box.min, toMax = box.max - center;
+            int axis = 0;
+            float nearest = std::min(toMin[0], toMax[0]);
+            for (int a = 1; a < 3; a++) {
+                if (std::min(toMin[a], toMax[a]) < nearest) {
+                    nearest = std::min(toMin[a], toMax[a]);
+                    axis = a;
+                }
+            }
+            normal = glm::vec3(0.0f);
+            normal[axis] = toMin[axis] < toMax[axis] ? 1.0f : -1.0f;
+            depth = radius + nearest;
+        }
+        contacts.push_back({m_Bodies[i], Box, normal, depth});
+        m_Stats.boxContacts++;
+    }
+};
+
+// A belt of count rocks at the density of the scene's, 200 in a ring 20 across and 6 wide,
+// orbiting at their own speeds, and a shuttle box flying along it. Rebuild, pairs and shuttle
+// test per frame on the job system, the total on one thread, and a brute force check of the
+// pairs for the smaller belts.
+inline void benchmarkCollisions() {
+    const int frames = 30;
+    const float rockRadius = 0.8f * 0.87f, planetMass = 720.0f;
+    JobSystem jobs;
+    std::cout << "Spatial hash collisions of a moving belt, " << frames << " frames, " << jobs.threadCount()
+              << " threads for the parallel run, times are per frame in ms\n";
+    BenchmarkTable table({"bodies", "build", "pairs", "shuttle", "total", "1 thread", "tests/body", "contacts", "max/cell"});
+    srand(1);
+    for (unsigned int count : {10000u, 100000u, 1000000u}) {
+        const float scale = std::sqrt((float) count / 200.0f);
+        std::vector<float> distance(count), height(count), phase(count), speed(count);
+        for (unsigned int i = 0; i < count; i++) {
+            distance[i] = scale * (20.0f + 6.0f * ((float) rand() / (float) RAND_MAX - 0.5f));
+            height[i] = 2.0f * ((float) rand() / (float) RAND_MAX - 0.5f);
+            phase[i] = 6.2831853f * (float) rand() / (float) RAND_MAX;
+            speed[i] = std::sqrt(planetMass * scale * scale * scale / (distance[i] * distance[i] * distance[i]));
+        }
+        std::vector<Sphere> bodies(count);
+        auto moveRocks = [&](float time) {
+            for (unsigned int i = 0; i < count; i++) {
+                float angle = phase[i] + speed[i] * time;
+                bodies[i] = {glm::vec3(distance[i] * std::cos(angle), height[i], distance[i] * std::sin(angle)), rockRadius};
+            }
+        };
+
+        SpatialHashGrid grid;
+        std::vector<Contact> contacts, shuttleContacts;
+        double build = 0.0, pairs = 0.0, shuttle = 0.0, serial = 0.0;
+        for (int frame = 0; frame < frames; frame++) {
+            float time = (float) frame / 60.0f;
+            moveRocks(time);
+            glm::vec3 ship(scale * 20.0f * std::cos(time), 0.0f, scale * 20.0f * std::sin(time));
+            AABB box(ship - glm::vec3(0.5f), ship + glm::vec3(0.5f));
+
+            Stopwatch sw;
+            grid.build(bodies);
+            grid.findPairs(contacts);
+            grid.collide(box, shuttleContacts);
+            serial += sw.elapsedMilliseconds();
+
+            sw.reset();
+            grid.build(bodies, &jobs);
+            build += sw.elapsedMilliseconds();
+            sw.reset();
+            grid.findPairs(contacts, &jobs);
+            pairs += sw.elapsedMilliseconds();
+            sw.reset();
+            shuttleContacts.clear();
+            grid.collide(box, shuttleContacts);
+            shuttle += sw.elapsedMilliseconds();
+        }
+        if (count <= 10000) {
+            unsigned int brute = 0;
+            for (unsigned int i = 0; i < count; i++) {
+                for (unsigned int j = i + 1; j < count; j++) {
+                    glm::vec3 d = bodies[j].center - bodies[i].center;
+                    float reach = bodies[i].radius + bodies[j].radius;
+                    brute += glm::dot(d, d) < reach * reach ? 1 : 0;
+                }
+            }
+            if (brute != contacts.size())
+                std::cerr << "Spatial hash found " << contacts.size() << " pairs, brute force " << brute << '\n';
+        }
+        const SpatialHashGrid::Stats &stats = grid.stats();
+        table.row(count, build / frames, pairs / frames, shuttle / frames, (build + pairs + shuttle) / frames,
+                  serial / frames, (double) stats.tests / count, stats.pairs, stats.maxPerCell);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_COLLISION_H
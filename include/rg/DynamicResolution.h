@@ -0,0 +1,142 @@
+//
+// Picks the fraction of the render targets the scene is drawn into from measured GPU time.
+//
+
+#ifndef PROJECT_BASE_DYNAMICRESOLUTION_H
+#define PROJECT_BASE_DYNAMICRESOLUTION_H
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace rg {
+
+// Frames are timed with GL_TIME_ELAPSED queries from a small ring. Results are read a few
+// frames later, once the GPU reports them available, so measuring never stalls the CPU.
+// The smoothed time drives the scale: pixel count grows with scale squared, so the scale is
+// moved by the square root of target / measured, at most maxStep at a time and only after
+// the previous change has had cooldownFrames to show up in the measurements.
+class DynamicResolution {
+public:
+    struct Sample {
+        unsigned int frame;
+        float gpuMilliseconds;
+        float scale;
+    };
+
+    float targetMilliseconds = 1000.0f / 60.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float maxStep = 0.05f;
+    float smoothing = 0.1f;           // weight of a new measurement in the moving average
+    unsigned int cooldownFrames = 15;
+    bool enabled = true;
+    bool logChanges = false;          // a line on stdout per scale change
+
+    DynamicResolution() {
+        glGenQueries(QueryCount, m_Queries);
+    }
+
+    ~DynamicResolution() {
+        glDeleteQueries(QueryCount, m_Queries);
+    }
+
+    DynamicResolution(const DynamicResolution &) = delete;
+    DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+    // Brackets the GPU work of one frame. A frame is left unmeasured when every query is
+    // still waiting for its result.
+    void beginFrame() {
+        collectResults();
+        m_Frame++;
+        m_Measuring = m_Pending[m_Next] == 0;
+        if (m_Measuring)
+            glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Next]);
+    }
+
+    void endFrame() {
+        if (!m_Measuring)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        m_Pending[m_Next] = m_Frame;
+        m_Next = (m_Next + 1) % QueryCount;
+        m_Measuring = false;
+    }
+
+    float scale() const { return enabled ? m_Scale : maxScale; }
+    float gpuMilliseconds() const { return m_Smoothed; }
+
+    // size of the viewport inside targets allocated for width x height
+    int scaledWidth(int width) const { return std::max(1, (int) std::lround(width * scale())); }
+    int scaledHeight(int height) const { return std::max(1, (int) std::lround(height * scale())); }
+
+    // how much the upscale should sharpen, nothing at full resolution
+    float sharpness() const { return std::min(0.5f, (maxScale - scale()) * 1.5f); }
+
+    // one entry per measured frame, the last HistorySize of them
+    const std::vector<Sample> &history() const { return m_History; }
+
+private:
+    static const int QueryCount = 4;
+    static const unsigned int HistorySize = 600;
+
+    unsigned int m_Queries[QueryCount];
+    unsigned int m_Pending[QueryCount] = {};   // frame the query measured, 0 when free
+    int m_Next = 0;
+    bool m_Measuring = false;
+    unsigned int m_Frame = 0;
+    unsigned int m_LastChange = 0;
+    float m_Scale = 1.0f;
+    float m_Smoothed = 0.0f;
+    std::vector<Sample> m_History;
+
+    void collectResults() {
+        for (int i = 0; i < QueryCount; i++) {
+            int q = (m_Next + i) % QueryCount;   // oldest first
+            if (!m_Pending[q])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(m_Queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(m_Queries[q], GL_QUERY_RESULT, &nanoseconds);
+            addMeasurement(m_Pending[q], (float) (nanoseconds / 1.0e6));
+            m_Pending[q] = 0;
+        }
+    }
+
+    void addMeasurement(unsigned int frame, float milliseconds) {
+        m_Smoothed = m_Smoothed == 0.0f ? milliseconds : m_Smoothed + (milliseconds - m_Smoothed) * smoothing;
+        if (m_History.size() == HistorySize)
+            m_History.erase(m_History.begin());
+        m_History.push_back({frame, milliseconds, m_Scale});
+
+        if (!enabled || frame < m_LastChange + cooldownFrames)
+            return;
+        float wanted = m_Scale * std::sqrt(targetMilliseconds / m_Smoothed);
+        // a bit of slack below the target keeps the scale from oscillating around it
+        if (m_Smoothed < targetMilliseconds && m_Smoothed > 0.85f * targetMilliseconds)
+            return;
+        float next = std::max(minScale, std::min(maxScale, m_Scale + std::max(-maxStep, std::min(maxStep, wanted - m_Scale))));
+        if (std::abs(next - m_Scale) < 0.005f)
+            return;
+        m_Scale = next;
+        m_LastChange = m_Frame;
+        if (logChanges) {
+            // formatted apart, so std::cout keeps its own precision
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(2) << "Frame " << m_Frame << ": render scale " << m_Scale
+                 << " (GPU " << m_Smoothed << " ms, target " << targetMilliseconds << " ms)";
+            std::cout << line.str() << std::endl;
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_DYNAMICRESOLUTION_H
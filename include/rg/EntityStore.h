@@ -0,0 +1,274 @@
+//
+// Archetype based entity-component storage for the bodies of the solar system.
+//
+
+#ifndef PROJECT_BASE_ENTITYSTORE_H
+#define PROJECT_BASE_ENTITYSTORE_H
+
+#include <glm/glm.hpp>
+#include <rg/Benchmark.h>
+#include <rg/JobSystem.h>
+#include <rg/SceneGraph.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace rg {
+
+typedef unsigned int Entity;
+
+struct Transform {
+    SceneGraph::Node pivot = SceneGraph::None;  // orbit position, children are attached here
+    SceneGraph::Node body = SceneGraph::None;   // spin and scale of the body itself
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 spinAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float spinSpeed = 0.0f;
+    float spinAngle = 0.0f;
+};
+
+// Circular orbit around the pivot of the parent body.
+struct Orbit {
+    float distance = 0.0f;
+    float height = 0.0f;
+    float speed = 0.0f;
+    float phase = 0.0f;
+};
+
+struct Renderable {
+    int model = -1;
+    int shader = -1;
+    float boundingRadius = 1.0f;
+    float occluderRadius = 0.0f;   // 0 when the body doesn't hide anything
+};
+
+struct Light {
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(1.0f);
+    glm::vec3 specular = glm::vec3(1.0f);
+    float constant = 1.0f;
+    float linear = 0.09f;
+    float quadratic = 0.032f;
+    // 0 lights the whole scene, a local light reaches range and goes through the light clusters
+    float range = 0.0f;
+    // a spot light shines along +y of its node, cosines of the inner and outer cone angles
+    bool spot = false;
+    float cutOff = 1.0f;
+    float outerCutOff = 1.0f;
+};
+
+enum ComponentMask : unsigned int {
+    TransformComponent = 1u << 0,
+    OrbitComponent = 1u << 1,
+    RenderableComponent = 1u << 2,
+    LightComponent = 1u << 3
+};
+
+// All entities with the same set of components share an archetype. Every component type
+// is its own tightly packed array and row i of each array belongs to entities[i], so a
+// system walks a handful of contiguous arrays no matter how many entities there are.
+struct Archetype {
+    unsigned int mask = 0;
+    std::vector<Entity> entities;
+    std::vector<Transform> transforms;
+    std::vector<Orbit> orbits;
+    std::vector<Renderable> renderables;
+    std::vector<Light> lights;
+
+    unsigned int size() const { return (unsigned int)entities.size(); }
+};
+
+class EntityStore {
+public:
+    Entity create(unsigned int mask) {
+        Entity entity;
+        if (!m_Free.empty()) {
+            entity = m_Free.back();
+            m_Free.pop_back();
+        } else {
+            entity = (Entity)m_Records.size();
+            m_Records.push_back(Record());
+        }
+        int a = archetypeFor(mask);
+        Archetype &archetype = m_Archetypes[a];
+        m_Records[entity].archetype = a;
+        m_Records[entity].row = archetype.size();
+        archetype.entities.push_back(entity);
+        if (mask & TransformComponent) archetype.transforms.push_back(Transform());
+        if (mask & OrbitComponent) archetype.orbits.push_back(Orbit());
+        if (mask & RenderableComponent) archetype.renderables.push_back(Renderable());
+        if (mask & LightComponent) archetype.lights.push_back(Light());
+        m_Alive++;
+        return entity;
+    }
+
+    // Swaps the last row of the archetype into the hole, so arrays stay dense.
+    void destroy(Entity entity) {
+        Record &record = m_Records[entity];
+        Archetype &archetype = m_Archetypes[record.archetype];
+        unsigned int last = archetype.size() - 1;
+        Entity moved = archetype.entities[last];
+        removeRow(archetype.entities, record.row, last);
+        if (archetype.mask & TransformComponent) removeRow(archetype.transforms, record.row, last);
+        if (archetype.mask & OrbitComponent) removeRow(archetype.orbits, record.row, last);
+        if (archetype.mask & RenderableComponent) removeRow(archetype.renderables, record.row, last);
+        if (archetype.mask & LightComponent) removeRow(archetype.lights, record.row, last);
+        m_Records[moved].row = record.row;
+        record.archetype = -1;
+        m_Free.push_back(entity);
+        m_Alive--;
+    }
+
+    bool has(Entity entity, unsigned int mask) const {
+        const Record &record = m_Records[entity];
+        return record.archetype >= 0 && (m_Archetypes[record.archetype].mask & mask) == mask;
+    }
+
+    Transform &transform(Entity e) { return m_Archetypes[m_Records[e].archetype].transforms[m_Records[e].row]; }
+    Orbit &orbit(Entity e) { return m_Archetypes[m_Records[e].archetype].orbits[m_Records[e].row]; }
+    Renderable &renderable(Entity e) { return m_Archetypes[m_Records[e].archetype].renderables[m_Records[e].row]; }
+    Light &light(Entity e) { return m_Archetypes[m_Records[e].archetype].lights[m_Records[e].row]; }
+
+    // Calls fn(archetype) for every non-empty archetype that has at least the given components.
+    template<typename Function>
+    void forEach(unsigned int mask, Function &&fn) {
+        for (Archetype &archetype : m_Archetypes) {
+            if ((archetype.mask & mask) == mask && !archetype.entities.empty())
+                fn(archetype);
+        }
+    }
+
+    unsigned int size() const { return m_Alive; }
+
+private:
+    struct Record {
+        int archetype = -1;
+        unsigned int row = 0;
+    };
+
+    std::vector<Archetype> m_Archetypes;
+    std::vector<Record> m_Records;
+    std::vector<Entity> m_Free;
+    unsigned int m_Alive = 0;
+
+    int archetypeFor(unsigned int mask) {
+        for (unsigned int i = 0; i < m_Archetypes.size(); i++) {
+            if (m_Archetypes[i].mask == mask)
+                return (int)i;
+        }
+        m_Archetypes.push_back(Archetype());
+        m_Archetypes.back().mask = mask;
+        return (int)m_Archetypes.size() - 1;
+    }
+
+    template<typename T>
+    static void removeRow(std::vector<T> &column, unsigned int row, unsigned int last) {
+        column[row] = column[last];
+        column.pop_back();
+    }
+};
+
+// Systems ---------------------------------------------------------------------------------
+// Each one is a loop over archetype arrays; with a JobSystem the rows are split across threads.
+
+inline void updateOrbits(EntityStore &store, float time, JobSystem *jobs = nullptr) {
+    store.forEach(TransformComponent | OrbitComponent, [time, jobs](Archetype &a) {
+        Transform *transforms = a.transforms.data();
+        const Orbit *orbits = a.orbits.data();
+        auto update = [=](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                float angle = orbits[i].phase + orbits[i].speed * time;
+                transforms[i].position = glm::vec3(orbits[i].distance * cos(angle), orbits[i].height,
+                                                   orbits[i].distance * sin(angle));
+            }
+        };
+        if (jobs)
+            jobs->parallelFor(a.size(), 4096, update);
+        else
+            update(0, a.size());
+    });
+}
+
+inline void updateSpin(EntityStore &store, float time, JobSystem *jobs = nullptr) {
+    store.forEach(TransformComponent, [time, jobs](Archetype &a) {
+        Transform *transforms = a.transforms.data();
+        auto update = [=](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                transforms[i].spinAngle = transforms[i].spinSpeed * time;
+        };
+        if (jobs)
+            jobs->parallelFor(a.size(), 4096, update);
+        else
+            update(0, a.size());
+    });
+}
+
+// Hands positions and spins over to the scene graph, which composes them with the parents.
+inline void syncSceneGraph(EntityStore &store, SceneGraph &scene) {
+    store.forEach(TransformComponent, [&scene](Archetype &a) {
+        for (const Transform &t : a.transforms) {
+            if (t.pivot != SceneGraph::None)
+                scene.setPosition(t.pivot, t.position);
+            if (t.body != SceneGraph::None)
+                scene.setRotation(t.body, t.spinAngle, t.spinAxis);
+        }
+    });
+}
+
+// Orbit + spin update on the archetype store against one heap object per body, the way
+// a per-body struct or class hierarchy would lay them out.
+inline void benchmarkEntityStore() {
+    struct Body {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 spinAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+        float spinSpeed = 0.0f, spinAngle = 0.0f;
+        float distance = 0.0f, height = 0.0f, speed = 0.0f, phase = 0.0f;
+        glm::mat4 model = glm::mat4(1.0f);
+        char name[32] = {};
+    };
+    const int frames = 100;
+    JobSystem jobs;
+    std::cout << "Orbit + spin systems, " << frames << " frames, " << jobs.threadCount()
+              << " threads for the parallel run, times are per frame in ms\n";
+    BenchmarkTable table({"entities", "objects", "archetype", "parallel", "ns/entity"});
+    for (int count : {10, 1000, 100000}) {
+        std::vector<std::unique_ptr<Body>> bodies;
+        EntityStore store;
+        for (int i = 0; i < count; i++) {
+            bodies.emplace_back(new Body());
+            bodies.back()->distance = 20.0f + (float)(i % 7);
+            bodies.back()->speed = 0.001f * (float)i;
+            bodies.back()->spinSpeed = 0.5f;
+            Entity e = store.create(TransformComponent | OrbitComponent | RenderableComponent);
+            store.orbit(e).distance = bodies.back()->distance;
+            store.orbit(e).speed = bodies.back()->speed;
+            store.transform(e).spinSpeed = 0.5f;
+        }
+
+        double objects = 0.0, archetype = 0.0, parallel = 0.0;
+        for (int frame = 0; frame < frames; frame++) {
+            float time = (float)frame / 60.0f;
+            Stopwatch sw;
+            for (std::unique_ptr<Body> &b : bodies) {
+                float angle = b->phase + b->speed * time;
+                b->position = glm::vec3(b->distance * cos(angle), b->height, b->distance * sin(angle));
+                b->spinAngle = b->spinSpeed * time;
+            }
+            objects += sw.elapsedMilliseconds();
+
+            sw.reset();
+            updateOrbits(store, time);
+            updateSpin(store, time);
+            archetype += sw.elapsedMilliseconds();
+
+            sw.reset();
+            updateOrbits(store, time, &jobs);
+            updateSpin(store, time, &jobs);
+            parallel += sw.elapsedMilliseconds();
+        }
+        table.row(count, objects / frames, archetype / frames, parallel / frames, archetype / frames * 1e6 / count);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_ENTITYSTORE_H
@@ -0,0 +1,419 @@
+//
+// Render passes declared with their inputs and outputs, compiled and executed once per frame.
+//
+
+#ifndef PROJECT_BASE_FRAMEGRAPH_H
+#define PROJECT_BASE_FRAMEGRAPH_H
+
+#include <glad/glad.h>
+#include <rg/Benchmark.h>
+#include <rg/Error.h>
+#include <rg/RenderTargetPool.h>
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Every frame the passes are added again with a setup callback that declares what they read
+// and write, and an execute callback that draws. compile() then
+//  - culls passes whose outputs nobody reads, unless they write an imported target such as
+//    the default framebuffer,
+//  - orders the rest so every pass runs after the passes producing its inputs; a target
+//    several passes write is read as the writers declared before the reader left it, and
+//    the writers declared after it wait until it has read,
+//  - works out when each transient target is first and last used, so execute() can acquire
+//    it from the pool right before its first pass and release it right after its last,
+//  - clears a target only in the pass that writes it first, and only if that pass doesn't
+//    promise to overwrite every pixel anyway.
+// Pass timings survive from frame to frame, keyed by pass name, for dump().
+class FrameGraph {
+public:
+    typedef int Resource;
+    static const Resource None = -1;
+
+private:
+    struct Write {
+        Resource resource;
+        bool overwritesAll;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Write> writes;
+        std::vector<Resource> clears;
+        std::function<void(FrameGraph &)> execute;
+        int areaWidth = 0, areaHeight = 0;
+        int references = 0;
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+public:
+    class Builder {
+    public:
+        void read(Resource resource) {
+            if (resource != None)
+                m_Pass.reads.push_back(resource);
+        }
+
+        // overwritesAll: the pass writes every pixel of its render area, no clear needed
+        void write(Resource resource, bool overwritesAll = false) {
+            m_Pass.writes.push_back({resource, overwritesAll});
+        }
+
+        // the part of the targets the pass draws to, viewport and clears are limited to it
+        void setRenderArea(int width, int height) {
+            m_Pass.areaWidth = width;
+            m_Pass.areaHeight = height;
+        }
+
+    private:
+        friend class FrameGraph;
+        Pass &m_Pass;
+        explicit Builder(Pass &pass) : m_Pass(pass) {}
+    };
+
+    explicit FrameGraph(RenderTargetPool &pool) : m_Pool(pool) {}
+
+    ~FrameGraph() {
+        for (Timing &timing : m_QuerySlots)
+            glDeleteQueries((GLsizei) timing.queries.size(), timing.queries.data());
+    }
+
+    FrameGraph(const FrameGraph &) = delete;
+    FrameGraph &operator=(const FrameGraph &) = delete;
+
+    // Forgets last frame's passes and resources, timings are kept.
+    void reset() {
+        m_Passes.clear();
+        m_Resources.clear();
+        m_Order.clear();
+    }
+
+    // A target the graph allocates from the pool for the frame.
+    Resource create(const std::string &name, const RenderTargetDesc &desc) {
+        ResourceEntry resource;
+        resource.name = name;
+        resource.desc = desc;
+        m_Resources.push_back(resource);
+        return (Resource) m_Resources.size() - 1;
+    }
+
+    // A framebuffer that lives outside the graph; writing to it keeps a pass alive. Without
+    // sideEffect it's a target kept across frames that only matters while a pass reads it,
+    // and its writers are culled like those of transient targets.
+    Resource import(const std::string &name, unsigned int framebuffer, int width, int height, bool sideEffect = true) {
+        ResourceEntry resource;
+        resource.name = name;
+        resource.desc = RenderTargetDesc(width, height, GL_RGBA8);
+        resource.imported = true;
+        resource.sideEffect = sideEffect;
+        resource.framebuffer = framebuffer;
+        m_Resources.push_back(resource);
+        return (Resource) m_Resources.size() - 1;
+    }
+
+    void addPass(const std::string &name, const std::function<void(Builder &)> &setup,
+                 const std::function<void(FrameGraph &)> &execute) {
+        m_Passes.push_back(Pass());
+        Pass &pass = m_Passes.back();
+        pass.name = name;
+        pass.execute = execute;
+        Builder builder(pass);
+        setup(builder);
+    }
+
+    void compile() {
+        const int passCount = (int) m_Passes.size();
+        for (ResourceEntry &resource : m_Resources) {
+            resource.readers = 0;
+            resource.writers.clear();
+            resource.firstPass = resource.lastPass = -1;
+        }
+        for (int p = 0; p < passCount; p++) {
+            Pass &pass = m_Passes[p];
+            pass.culled = false;
+            pass.clears.clear();
+            pass.references = (int) pass.writes.size();
+            pass.sideEffect = false;
+            for (const Write &write : pass.writes) {
+                m_Resources[write.resource].writers.push_back(p);
+                pass.sideEffect |= m_Resources[write.resource].sideEffect;
+            }
+            for (Resource r : pass.reads)
+                m_Resources[r].readers++;
+        }
+
+        // culling: resources nobody reads release their writers, culled passes release their inputs
+        std::vector<Resource> unread;
+        for (unsigned int r = 0; r < m_Resources.size(); r++) {
+            if (m_Resources[r].readers == 0 && !m_Resources[r].sideEffect)
+                unread.push_back((Resource) r);
+        }
+        while (!unread.empty()) {
+            Resource r = unread.back();
+            unread.pop_back();
+            for (int p : m_Resources[r].writers) {
+                Pass &pass = m_Passes[p];
+                if (pass.culled || pass.sideEffect || --pass.references > 0)
+                    continue;
+                pass.culled = true;
+                for (Resource input : pass.reads) {
+                    if (--m_Resources[input].readers == 0 && !m_Resources[input].sideEffect)
+                        unread.push_back(input);
+                }
+            }
+        }
+
+        // ordering: producers before consumers, writers of the same target in declaration order
+        std::vector<std::vector<int>> next(passCount);
+        std::vector<int> incoming(passCount, 0);
+        auto addEdge = [&](int from, int to) {
+            if (from == to || m_Passes[from].culled || m_Passes[to].culled)
+                return;
+            next[from].push_back(to);
+            incoming[to]++;
+        };
+        for (int p = 0; p < passCount; p++) {
+            for (Resource r : m_Passes[p].reads) {
+                const std::vector<int> &writers = m_Resources[r].writers;
+                bool writtenBefore = std::any_of(writers.begin(), writers.end(), [p](int writer) { return writer < p; });
+                for (int writer : writers) {
+                    if (!writtenBefore || writer < p)
+                        addEdge(writer, p);
+                    else
+                        addEdge(p, writer);
+                }
+            }
+        }
+        for (const ResourceEntry &resource : m_Resources) {
+            for (unsigned int i = 1; i < resource.writers.size(); i++)
+                addEdge(resource.writers[i - 1], resource.writers[i]);
+        }
+        std::vector<int> ready;
+        for (int p = 0; p < passCount; p++) {
+            if (!m_Passes[p].culled && incoming[p] == 0)
+                ready.push_back(p);
+        }
+        while (!ready.empty()) {
+            // lowest declaration index first keeps the order stable
+            std::vector<int>::iterator lowest = std::min_element(ready.begin(), ready.end());
+            int p = *lowest;
+            ready.erase(lowest);
+            m_Order.push_back(p);
+            for (int n : next[p]) {
+                if (--incoming[n] == 0)
+                    ready.push_back(n);
+            }
+        }
+        int live = (int) std::count_if(m_Passes.begin(), m_Passes.end(), [](const Pass &pass) { return !pass.culled; });
+        ASSERT((int) m_Order.size() == live, "Frame graph has a cycle!");
+
+        // lifetimes and clears
+        for (unsigned int i = 0; i < m_Order.size(); i++) {
+            Pass &pass = m_Passes[m_Order[i]];
+            auto use = [this, i](Resource r) {
+                ResourceEntry &resource = m_Resources[r];
+                if (resource.firstPass < 0)
+                    resource.firstPass = (int) i;
+                resource.lastPass = (int) i;
+            };
+            for (Resource r : pass.reads)
+                use(r);
+            for (const Write &write : pass.writes) {
+                bool firstWrite = m_Resources[write.resource].firstPass < 0;
+                use(write.resource);
+                if (firstWrite && !write.overwritesAll)
+                    pass.clears.push_back(write.resource);
+            }
+        }
+    }
+
+    void execute() {
+        const int slot = m_Frame % QuerySlots;
+        collectTimings(m_QuerySlots[slot]);
+        Timing &timing = m_QuerySlots[slot];
+        timing.passes.clear();
+        unsigned int queriesNeeded = (unsigned int) m_Order.size() * 2;
+        if (timing.queries.size() < queriesNeeded) {
+            unsigned int old = (unsigned int) timing.queries.size();
+            timing.queries.resize(queriesNeeded);
+            glGenQueries((GLsizei) (queriesNeeded - old), timing.queries.data() + old);
+        }
+
+        for (unsigned int i = 0; i < m_Order.size(); i++) {
+            Pass &pass = m_Passes[m_Order[i]];
+            for (ResourceEntry &resource : m_Resources) {
+                if (resource.firstPass == (int) i && !resource.imported)
+                    resource.target = m_Pool.acquire(resource.desc);
+            }
+
+            Stopwatch cpu;
+            glQueryCounter(timing.queries[2 * i], GL_TIMESTAMP);
+            bindTargets(pass);
+            pass.execute(*this);
+            glQueryCounter(timing.queries[2 * i + 1], GL_TIMESTAMP);
+            m_Stats[pass.name].cpuMilliseconds = (float) cpu.elapsedMilliseconds();
+            timing.passes.push_back(pass.name);
+
+            for (ResourceEntry &resource : m_Resources) {
+                if (resource.lastPass == (int) i && !resource.imported) {
+                    m_Pool.release(resource.target);
+                    resource.target = RenderTargetPool::None;
+                }
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        timing.pending = true;
+        m_Frame++;
+    }
+
+    // for execute callbacks
+    unsigned int texture(Resource resource) const { return m_Pool.texture(m_Resources[resource].target); }
+    RenderTargetPool::Target target(Resource resource) const { return m_Resources[resource].target; }
+    const RenderTargetDesc &desc(Resource resource) const { return m_Resources[resource].desc; }
+
+    // The compiled frame: executed passes in order with their inputs, outputs and clears,
+    // culled passes, target lifetimes and the latest CPU and GPU time of every pass.
+    void dump(std::ostream &out) const {
+        out << "Frame graph: " << m_Order.size() << " of " << m_Passes.size() << " passes, "
+            << m_Pool.size() << " pooled targets (" << m_Pool.bytesAllocated() / (1024 * 1024) << " MB)\n";
+        for (unsigned int i = 0; i < m_Order.size(); i++) {
+            const Pass &pass = m_Passes[m_Order[i]];
+            std::map<std::string, Stats>::const_iterator found = m_Stats.find(pass.name);
+            Stats stats = found == m_Stats.end() ? Stats() : found->second;
+            out << "  " << i << ' ' << std::left << std::setw(12) << pass.name << std::right << std::fixed
+                << std::setprecision(3) << " cpu " << stats.cpuMilliseconds << " ms, gpu "
+                << stats.gpuMilliseconds << " ms\n";
+            out << "      reads:";
+            for (Resource r : pass.reads)
+                out << ' ' << m_Resources[r].name;
+            out << "\n      writes:";
+            for (const Write &write : pass.writes) {
+                out << ' ' << m_Resources[write.resource].name;
+                if (std::find(pass.clears.begin(), pass.clears.end(), write.resource) != pass.clears.end())
+                    out << " (clear)";
+            }
+            out << '\n';
+        }
+        for (const Pass &pass : m_Passes) {
+            if (pass.culled)
+                out << "  culled " << pass.name << '\n';
+        }
+        for (const ResourceEntry &resource : m_Resources) {
+            out << "  " << std::left << std::setw(12) << resource.name << std::right << ' ' << resource.desc.width
+                << 'x' << resource.desc.height;
+            if (resource.imported)
+                out << " imported";
+            else if (resource.firstPass < 0)
+                out << " unused";
+            else
+                out << " passes " << resource.firstPass << ".." << resource.lastPass;
+            out << '\n';
+        }
+    }
+
+private:
+    struct ResourceEntry {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported = false;
+        bool sideEffect = false;
+        unsigned int framebuffer = 0;
+        RenderTargetPool::Target target = RenderTargetPool::None;
+        int readers = 0;
+        std::vector<int> writers;
+        int firstPass = -1, lastPass = -1;
+    };
+
+    struct Stats {
+        float cpuMilliseconds = 0.0f;
+        float gpuMilliseconds = 0.0f;
+    };
+
+    // Timestamp queries of one frame, read back QuerySlots frames later if they are ready.
+    struct Timing {
+        std::vector<unsigned int> queries;
+        std::vector<std::string> passes;
+        bool pending = false;
+    };
+
+    static const int QuerySlots = 3;
+
+    RenderTargetPool &m_Pool;
+    std::vector<Pass> m_Passes;
+    std::vector<ResourceEntry> m_Resources;
+    std::vector<int> m_Order;
+    std::map<std::string, Stats> m_Stats;
+    Timing m_QuerySlots[QuerySlots];
+    unsigned int m_Frame = 0;
+
+    void collectTimings(Timing &timing) {
+        if (!timing.pending)
+            return;
+        timing.pending = false;
+        if (timing.passes.empty())
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(timing.queries[timing.passes.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;   // dropped rather than waited for
+        for (unsigned int i = 0; i < timing.passes.size(); i++) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(timing.queries[2 * i], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(timing.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+            m_Stats[timing.passes[i]].gpuMilliseconds = (float) ((end - begin) / 1.0e6);
+        }
+    }
+
+    // Binds the framebuffer made of the pass's outputs, sets the viewport and clears what
+    // the compiled graph says needs clearing. Color outputs are attached in the order the
+    // pass declared its writes, which is the order of its fragment outputs.
+    void bindTargets(const Pass &pass) {
+        if (pass.writes.empty())
+            return;
+        std::vector<RenderTargetPool::Target> colors;
+        RenderTargetPool::Target depth = RenderTargetPool::None;
+        unsigned int framebuffer = 0;
+        int width = 0, height = 0;
+        for (const Write &write : pass.writes) {
+            const ResourceEntry &resource = m_Resources[write.resource];
+            width = resource.desc.width;
+            height = resource.desc.height;
+            if (resource.imported)
+                framebuffer = resource.framebuffer;
+            else if (resource.desc.isDepth())
+                depth = resource.target;
+            else
+                colors.push_back(resource.target);
+        }
+        if (!colors.empty() || depth != RenderTargetPool::None)
+            framebuffer = m_Pool.framebuffer(colors, depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (pass.areaWidth > 0) {
+            width = pass.areaWidth;
+            height = pass.areaHeight;
+        }
+        glViewport(0, 0, width, height);
+
+        GLbitfield mask = 0;
+        for (Resource r : pass.clears)
+            mask |= m_Resources[r].desc.isDepth() ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT;
+        if (mask) {
+            glScissor(0, 0, width, height);
+            glEnable(GL_SCISSOR_TEST);
+            glClear(mask);
+            glDisable(GL_SCISSOR_TEST);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRAMEGRAPH_H
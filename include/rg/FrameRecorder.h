@@ -0,0 +1,176 @@
+//
+// Per-frame CPU and GPU times of a benchmark run, written to CSV with percentile summaries.
+//
+
+#ifndef PROJECT_BASE_FRAMERECORDER_H
+#define PROJECT_BASE_FRAMERECORDER_H
+
+#include <glad/glad.h>
+#include <rg/Benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Every recorded frame gets its CPU time (beginFrame to endFrame), its wall time (one
+// beginFrame to the next, swap included) and its GPU time from a pair of GL_TIMESTAMP
+// queries. Timestamps rather than GL_TIME_ELAPSED, because DynamicResolution already has an
+// elapsed query open around the frame and those can't nest. Query pairs come from a ring
+// and are read once available; a frame whose pair is still busy when the ring comes around
+// again is left without a GPU time instead of waiting. finish() waits for the last ones.
+class FrameRecorder {
+public:
+    struct Frame {
+        unsigned int index;
+        float simulatedTime;
+        float cpuMilliseconds;
+        float frameMilliseconds;   // negative for the last frame, nothing came after it
+        float gpuMilliseconds;     // negative when it couldn't be measured
+    };
+
+    struct Summary {
+        float mean = 0.0f, p50 = 0.0f, p95 = 0.0f, p99 = 0.0f, max = 0.0f;
+        unsigned int count = 0;
+    };
+
+    FrameRecorder() {
+        glGenQueries(QueryCount * 2, m_Queries);
+    }
+
+    ~FrameRecorder() {
+        glDeleteQueries(QueryCount * 2, m_Queries);
+    }
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    void beginFrame(unsigned int index, float simulatedTime) {
+        collect(false);
+        if (!m_Frames.empty())
+            m_Frames.back().frameMilliseconds = (float) m_FrameClock.elapsedMilliseconds();
+        m_FrameClock.reset();
+        m_Frames.push_back({index, simulatedTime, 0.0f, -1.0f, -1.0f});
+        m_Measuring = m_Pending[m_Next] < 0;
+        if (m_Measuring)
+            glQueryCounter(m_Queries[2 * m_Next], GL_TIMESTAMP);
+    }
+
+    void endFrame() {
+        m_Frames.back().cpuMilliseconds = (float) m_FrameClock.elapsedMilliseconds();
+        if (!m_Measuring)
+            return;
+        glQueryCounter(m_Queries[2 * m_Next + 1], GL_TIMESTAMP);
+        m_Pending[m_Next] = (int) m_Frames.size() - 1;
+        m_Next = (m_Next + 1) % QueryCount;
+        m_Measuring = false;
+    }
+
+    // Waits for the queries still in flight, call once after the last frame.
+    void finish() {
+        glFinish();
+        collect(true);
+    }
+
+    const std::vector<Frame> &frames() const { return m_Frames; }
+
+    // Nearest rank percentiles of one column; negative values (unmeasured) are left out.
+    Summary summarize(float Frame::*column) const {
+        std::vector<float> values;
+        for (const Frame &frame : m_Frames) {
+            if (frame.*column >= 0.0f)
+                values.push_back(frame.*column);
+        }
+        Summary summary;
+        if (values.empty())
+            return summary;
+        std::sort(values.begin(), values.end());
+        auto rank = [&values](float p) {
+            int i = (int) std::ceil(p * (float) values.size()) - 1;
+            return values[std::max(0, std::min(i, (int) values.size() - 1))];
+        };
+        double sum = 0.0;
+        for (float v : values)
+            sum += v;
+        summary.count = (unsigned int) values.size();
+        summary.mean = (float) (sum / values.size());
+        summary.p50 = rank(0.50f);
+        summary.p95 = rank(0.95f);
+        summary.p99 = rank(0.99f);
+        summary.max = values.back();
+        return summary;
+    }
+
+    // One row per frame, times that weren't measured are left empty.
+    bool writeCSV(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        out << "frame,time_s,cpu_ms,frame_ms,gpu_ms\n";
+        out << std::fixed << std::setprecision(4);
+        for (const Frame &frame : m_Frames) {
+            out << frame.index << ',' << frame.simulatedTime << ',' << frame.cpuMilliseconds << ',';
+            if (frame.frameMilliseconds >= 0.0f)
+                out << frame.frameMilliseconds;
+            out << ',';
+            if (frame.gpuMilliseconds >= 0.0f)
+                out << frame.gpuMilliseconds;
+            out << '\n';
+        }
+        return (bool) out;
+    }
+
+    // One row per column with its count, mean and percentiles, also printed as a table.
+    bool writeSummaryCSV(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        const char *names[] = {"cpu_ms", "frame_ms", "gpu_ms"};
+        float Frame::*columns[] = {&Frame::cpuMilliseconds, &Frame::frameMilliseconds, &Frame::gpuMilliseconds};
+        out << "metric,count,mean,p50,p95,p99,max\n";
+        out << std::fixed << std::setprecision(4);
+        BenchmarkTable table({"metric", "count", "mean", "p50", "p95", "p99", "max"});
+        for (int i = 0; i < 3; i++) {
+            Summary s = summarize(columns[i]);
+            out << names[i] << ',' << s.count << ',' << s.mean << ',' << s.p50 << ',' << s.p95 << ',' << s.p99
+                << ',' << s.max << '\n';
+            table.row(names[i], s.count, s.mean, s.p50, s.p95, s.p99, s.max);
+        }
+        return (bool) out;
+    }
+
+private:
+    static const int QueryCount = 8;
+
+    unsigned int m_Queries[QueryCount * 2];
+    int m_Pending[QueryCount] = {-1, -1, -1, -1, -1, -1, -1, -1};   // frame the pair measured
+    int m_Next = 0;
+    bool m_Measuring = false;
+    Stopwatch m_FrameClock;
+    std::vector<Frame> m_Frames;
+
+    void collect(bool wait) {
+        for (int i = 0; i < QueryCount; i++) {
+            int q = (m_Next + i) % QueryCount;   // oldest first
+            if (m_Pending[q] < 0)
+                continue;
+            GLint available = 0;
+            if (!wait)
+                glGetQueryObjectiv(m_Queries[2 * q + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!wait && !available)
+                continue;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(m_Queries[2 * q], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(m_Queries[2 * q + 1], GL_QUERY_RESULT, &end);
+            m_Frames[m_Pending[q]].gpuMilliseconds = (float) ((end - begin) / 1.0e6);
+            m_Pending[q] = -1;
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRAMERECORDER_H
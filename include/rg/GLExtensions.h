@@ -0,0 +1,82 @@
+//
+// Entry points newer than the OpenGL 3.3 core that glad was generated for, loaded when available.
+//
+
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <glad/glad.h>
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+namespace rg {
+
+// Everything here is optional: code that uses a feature checks its flag and keeps a plain
+// 3.3 path for when it is false. A feature counts as available when the context version has
+// it in core or the matching ARB extension is listed, and its functions could be loaded.
+struct GLExtensions {
+    typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect,
+                                                           GLsizei drawCount, GLsizei stride);
+
+    // ARB_buffer_storage, core in 4.4: immutable buffers that stay mapped while the GPU reads them
+    bool bufferStorage = false;
+    BufferStorageProc BufferStorage = nullptr;
+
+    // ARB_multi_draw_indirect with ARB_base_instance, core in 4.3: many indexed draws from one
+    // buffer of commands, each with its own first instance
+    bool multiDrawIndirect = false;
+    MultiDrawElementsIndirectProc MultiDrawElementsIndirect = nullptr;
+};
+
+inline GLExtensions &glExtensions() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Call once the context is current and glad is loaded, with the same loader glad got.
+// disable leaves every feature off, to run the 3.3 paths on a driver that has them all.
+inline void loadGLExtensions(GLADloadproc load, bool disable = false) {
+    GLExtensions &extensions = glExtensions();
+    extensions = GLExtensions();
+    if (disable)
+        return;
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    auto core = [major, minor](int needMajor, int needMinor) {
+        return major > needMajor || (major == needMajor && minor >= needMinor);
+    };
+
+    if (core(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+        extensions.BufferStorage = (GLExtensions::BufferStorageProc) load("glBufferStorage");
+    extensions.bufferStorage = extensions.BufferStorage != nullptr;
+
+    if (core(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")))
+        extensions.MultiDrawElementsIndirect = (GLExtensions::MultiDrawElementsIndirectProc) load("glMultiDrawElementsIndirect");
+    extensions.multiDrawIndirect = extensions.MultiDrawElementsIndirect != nullptr;
+}
+
+}
+
+#endif //PROJECT_BASE_GLEXTENSIONS_H
@@ -0,0 +1,161 @@
+//
+// OpenGL context without a window, rendering into a framebuffer object instead.
+//
+
+#ifndef PROJECT_BASE_HEADLESS_H
+#define PROJECT_BASE_HEADLESS_H
+
+#include <glad/glad.h>
+#ifdef RG_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// A surfaceless EGL display needs neither an X server nor a GPU: with Mesa it falls back to
+// the llvmpipe software rasterizer, so the whole pipeline runs on CI and render nodes. The
+// context is OpenGL 3.3 core like the windowed one, and framebuffer() stands in for the
+// default framebuffer, with the same color and depth formats a window would get.
+// Builds without EGL (RG_HAVE_EGL undefined) get a context that always fails to start.
+class HeadlessContext {
+public:
+    HeadlessContext(int width, int height)
+            : m_Width(width), m_Height(height) {
+#ifdef RG_HAVE_EGL
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (m_Display == EGL_NO_DISPLAY)
+            m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major = 0, minor = 0;
+        if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &major, &minor)) {
+            std::cout << "Failed to initialize an EGL display" << std::endl;
+            return;
+        }
+        // the default surface type is a window, which a surfaceless display has none of
+        const EGLint configAttributes[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(m_Display, configAttributes, &config, 1, &configCount) || configCount == 0
+            || !eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "EGL display has no desktop OpenGL config" << std::endl;
+            return;
+        }
+        const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+        };
+        m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+        // no surface at all, everything is drawn into framebuffer objects
+        if (m_Context == EGL_NO_CONTEXT || !eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context)) {
+            std::cout << "Failed to create a surfaceless OpenGL 3.3 core context (EGL " << major << "." << minor
+                      << ")" << std::endl;
+            return;
+        }
+        if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return;
+        }
+        m_Ready = createFramebuffer();
+        if (m_Ready)
+            std::cout << "Headless " << m_Width << "x" << m_Height << " on " << glGetString(GL_RENDERER) << ", OpenGL "
+                      << glGetString(GL_VERSION) << std::endl;
+#else
+        std::cout << "Headless mode needs EGL, this build has none" << std::endl;
+#endif
+    }
+
+    ~HeadlessContext() {
+#ifdef RG_HAVE_EGL
+        if (m_Ready) {
+            glDeleteFramebuffers(1, &m_Framebuffer);
+            glDeleteRenderbuffers(2, m_Renderbuffers);
+        }
+        if (m_Display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (m_Context != EGL_NO_CONTEXT)
+                eglDestroyContext(m_Display, m_Context);
+            eglTerminate(m_Display);
+        }
+#endif
+    }
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    bool ready() const { return m_Ready; }
+    unsigned int framebuffer() const { return m_Framebuffer; }
+    int width() const { return m_Width; }
+    int height() const { return m_Height; }
+
+    // what glad was loaded with, for entry points it doesn't know
+    static GLADloadproc loader() {
+#ifdef RG_HAVE_EGL
+        return (GLADloadproc) eglGetProcAddress;
+#else
+        return nullptr;
+#endif
+    }
+
+    // Writes the color of framebuffer() to a binary PPM. Reading it back waits for the GPU,
+    // so call it once at the end, not every frame.
+    bool writePPM(const std::string &path) const {
+        std::vector<unsigned char> pixels((size_t) m_Width * m_Height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_Width, m_Height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            return false;
+        out << "P6\n" << m_Width << " " << m_Height << "\n255\n";
+        // OpenGL rows go bottom up, PPM rows top down
+        for (int y = m_Height - 1; y >= 0; y--)
+            out.write((const char *) pixels.data() + (size_t) y * m_Width * 3, m_Width * 3);
+        return (bool) out;
+    }
+
+private:
+    int m_Width;
+    int m_Height;
+    bool m_Ready = false;
+    unsigned int m_Framebuffer = 0;
+    unsigned int m_Renderbuffers[2] = {};
+#ifdef RG_HAVE_EGL
+    EGLDisplay m_Display = EGL_NO_DISPLAY;
+    EGLContext m_Context = EGL_NO_CONTEXT;
+#endif
+
+    bool createFramebuffer() {
+        glGenRenderbuffers(2, m_Renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_Width, m_Height);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_Width, m_Height);
+        glGenFramebuffers(1, &m_Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_Renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_Renderbuffers[1]);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "Headless framebuffer not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_HEADLESS_H
@@ -0,0 +1,145 @@
+//
+// Persistent worker threads for splitting loops over contiguous arrays.
+//
+
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <rg/TraceRecorder.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg {
+
+class JobSystem {
+public:
+    // chunks run by parallelFor show up in its captures, on whichever thread took them
+    TraceRecorder *trace = nullptr;
+
+    // threads counts the calling thread too, which always takes part in parallelFor
+    explicit JobSystem(unsigned int threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, threads);
+        for (unsigned int i = 1; i < threads; i++)
+            m_Workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_WakeUp.notify_all();
+        for (std::thread &worker : m_Workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    unsigned int threadCount() const { return (unsigned int)m_Workers.size() + 1; }
+
+    // Calls fn(begin, end) on chunks of at most grain items covering [0, count) and
+    // returns once all of them are done.
+    template<typename Function>
+    void parallelFor(unsigned int count, unsigned int grain, Function &&fn) {
+        grain = std::max(1u, grain);
+        if (m_Workers.empty() || count <= grain) {
+            if (count > 0)
+                fn(0u, count);
+            return;
+        }
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->fn = std::ref(fn);
+        job->count = count;
+        job->grain = grain;
+        job->chunks = (count + grain - 1) / grain;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Job = job;
+            m_Generation++;
+        }
+        m_WakeUp.notify_all();
+        run(*job);
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Finished.wait(lock, [&job]() { return job->done.load() == job->chunks; });
+        m_Job.reset();
+    }
+
+private:
+    struct Job {
+        std::function<void(unsigned int, unsigned int)> fn;
+        unsigned int count = 0, grain = 0, chunks = 0;
+        std::atomic<unsigned int> next{0};
+        std::atomic<unsigned int> done{0};
+    };
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Finished;
+    std::shared_ptr<Job> m_Job;
+    unsigned long long m_Generation = 0;
+    bool m_Stop = false;
+
+    // Each thread takes the next free chunk until none are left. A worker that wakes up
+    // late only ever sees an exhausted job, which its shared_ptr keeps alive.
+    void run(Job &job) {
+        for (;;) {
+            unsigned int chunk = job.next.fetch_add(1);
+            if (chunk >= job.chunks)
+                return;
+            unsigned int begin = chunk * job.grain;
+            {
+                TraceRecorder::Scope scope(trace, "parallelFor");
+                job.fn(begin, std::min(job.count, begin + job.grain));
+            }
+            if (job.done.fetch_add(1) + 1 == job.chunks) {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Finished.notify_all();
+            }
+        }
+    }
+
+    void workerLoop() {
+        unsigned long long seen = 0;
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_WakeUp.wait(lock, [this, seen]() { return m_Stop || m_Generation != seen; });
+                if (m_Stop)
+                    return;
+                seen = m_Generation;
+                job = m_Job;
+            }
+            if (job)
+                run(*job);
+        }
+    }
+};
+
+// Calls fn(chunk, begin, end) for chunks even shares of [0, count), on the jobs if there are
+// any and on the calling thread otherwise. Results kept per chunk and combined in chunk order
+// come out the same whatever the thread count.
+template<typename Function>
+void forChunks(JobSystem *jobs, unsigned int count, unsigned int chunks, Function &&fn) {
+    auto run = [&fn, count, chunks](unsigned int first, unsigned int last) {
+        for (unsigned int c = first; c < last; c++)
+            fn(c, (unsigned int) ((uint64_t) count * c / chunks), (unsigned int) ((uint64_t) count * (c + 1) / chunks));
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, run);
+    else
+        run(0, chunks);
+}
+
+}
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
@@ -0,0 +1,283 @@
+//
+// Clustered light assignment: the local lights that reach each cell of a froxel grid, for the forward shaders.
+//
+
+#ifndef PROJECT_BASE_LIGHTCLUSTERS_H
+#define PROJECT_BASE_LIGHTCLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/Benchmark.h>
+#include <rg/EntityStore.h>
+#include <rg/JobSystem.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+// One light as clusters.glsl reads it, six texels of the light buffer texture.
+struct ClusterLight {
+    glm::vec4 positionRange;       // world position, range
+    glm::vec4 ambientConstant;
+    glm::vec4 diffuseLinear;
+    glm::vec4 specularQuadratic;
+    glm::vec4 directionCutOff;     // world direction and cosine of the inner cone, spot lights only
+    glm::vec4 outerCutOffSpot;     // cosine of the outer cone, 1 in y for a spot light
+
+    static ClusterLight from(const Light &light, const glm::vec3 &position, const glm::vec3 &direction) {
+        return {glm::vec4(position, light.range), glm::vec4(light.ambient, light.constant),
+                glm::vec4(light.diffuse, light.linear), glm::vec4(light.specular, light.quadratic),
+                glm::vec4(direction, light.cutOff), glm::vec4(light.outerCutOff, light.spot ? 1.0f : 0.0f, 0.0f, 0.0f)};
+    }
+};
+
+// The view frustum between the near and far plane is cut into TilesX x TilesY tiles on screen
+// and Slices depth slices, spaced exponentially so the cells stay roughly as deep as they are
+// wide. assign() lists the lights whose range reaches each cell; a fragment then finds its cell
+// from its screen position and view depth and only evaluates those lights.
+//
+// Every depth slice is a job on the worker threads and owns its cells, so nothing is shared
+// while assigning. A light is first tested against the depth range of the slice, then the screen
+// rectangle of its bounding box clipped to that range picks the tiles; spot lights are bounded
+// by their range sphere like point lights. A cell keeps at most MaxLightsPerCell lights, further
+// ones are dropped and counted. The lists are then compacted into one index list.
+//
+// upload() hands the result to the shaders as buffer textures, which 3.3 has in core:
+//   lights   RGBA32F, six texels per ClusterLight
+//   cells    RG32UI, offset and count of the cell's run in the index list
+//   indices  R16UI, light numbers
+class LightClusters {
+public:
+    static const int TilesX = 16;
+    static const int TilesY = 9;
+    static const int Slices = 24;
+    static const int CellCount = TilesX * TilesY * Slices;
+    static const int MaxLightsPerCell = 128;
+
+    // std140 layout of the LightClusters block in clusters.glsl
+    struct Constants {
+        glm::uvec4 grid;    // tiles x, tiles y, slices
+        glm::vec4 depth;    // slice = log(view depth) * x + y, render area size in zw
+    };
+
+    struct Stats {
+        unsigned int lights = 0;
+        unsigned int assignments = 0;    // cell-light pairs
+        unsigned int occupiedCells = 0;
+        unsigned int maxPerCell = 0;
+        unsigned int dropped = 0;        // lights left out of full cells
+    };
+
+    LightClusters(float nearPlane, float farPlane)
+            : m_Near(nearPlane), m_Far(farPlane), m_CellLights(CellCount * MaxLightsPerCell),
+              m_CellCounts(CellCount), m_SliceDropped(Slices), m_Cells(CellCount * 2) {
+        for (int s = 0; s <= Slices; s++)
+            m_SliceDepth[s] = m_Near * std::pow(m_Far / m_Near, (float) s / Slices);
+    }
+
+    ~LightClusters() {
+        if (m_Textures[0]) {
+            glDeleteTextures(3, m_Textures);
+            glDeleteBuffers(3, m_Buffers);
+        }
+    }
+
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // Assigns lights to the cells of the frustum of view and projection (a symmetric perspective
+    // with the same planes). CPU only, upload() passes the result on.
+    void assign(const std::vector<ClusterLight> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+                JobSystem *jobs = nullptr) {
+        // light numbers are 16 bit
+        m_Lights.assign(lights.begin(), lights.begin() + std::min<size_t>(lights.size(), 65536));
+        // view space bounds, z as the distance in front of the camera
+        m_Bounds.resize(m_Lights.size());
+        for (size_t i = 0; i < m_Lights.size(); i++) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(m_Lights[i].positionRange), 1.0f));
+            m_Bounds[i] = glm::vec4(center.x, center.y, -center.z, m_Lights[i].positionRange.w);
+        }
+        const float scaleX = projection[0][0], scaleY = projection[1][1];
+        auto assignSlices = [&](unsigned int begin, unsigned int end) {
+            for (unsigned int slice = begin; slice < end; slice++)
+                assignSlice(slice, scaleX, scaleY);
+        };
+        if (jobs)
+            jobs->parallelFor(Slices, 1, assignSlices);
+        else
+            assignSlices(0, Slices);
+        compact();
+    }
+
+    // Creates the buffer textures on first use and fills them with the last assignment.
+    void upload() {
+        if (!m_Textures[0]) {
+            glGenBuffers(3, m_Buffers);
+            glGenTextures(3, m_Textures);
+            const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+            for (int i = 0; i < 3; i++) {
+                glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+                glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+                glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+                glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_Buffers[i]);
+            }
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        // an empty buffer texture can't be sampled, every buffer keeps at least one element
+        static const ClusterLight noLight = {};
+        static const uint16_t noIndex = 0;
+        uploadBuffer(0, m_Lights.empty() ? &noLight : m_Lights.data(), std::max<size_t>(m_Lights.size(), 1) * sizeof(ClusterLight));
+        uploadBuffer(1, m_Cells.data(), m_Cells.size() * sizeof(uint32_t));
+        uploadBuffer(2, m_Indices.empty() ? &noIndex : m_Indices.data(), std::max<size_t>(m_Indices.size(), 1) * sizeof(uint16_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Binds lights, cells and indices to units firstUnit, firstUnit + 1 and firstUnit + 2.
+    void bind(unsigned int firstUnit) const {
+        for (unsigned int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // for the render area the scene is drawn into, it sets where the tiles are on screen
+    Constants constants(int renderWidth, int renderHeight) const {
+        float scale = Slices / std::log(m_Far / m_Near);
+        return {glm::uvec4(TilesX, TilesY, Slices, 0),
+                glm::vec4(scale, -std::log(m_Near) * scale, (float) renderWidth, (float) renderHeight)};
+    }
+
+    const Stats &stats() const { return m_Stats; }
+
+private:
+    float m_Near, m_Far;
+    float m_SliceDepth[Slices + 1];
+    std::vector<ClusterLight> m_Lights;
+    std::vector<glm::vec4> m_Bounds;          // view space center and range
+    std::vector<uint16_t> m_CellLights;       // MaxLightsPerCell slots per cell
+    std::vector<uint16_t> m_CellCounts;
+    std::vector<unsigned int> m_SliceDropped;
+    std::vector<uint32_t> m_Cells;            // offset, count
+    std::vector<uint16_t> m_Indices;
+    Stats m_Stats;
+    unsigned int m_Buffers[3] = {0, 0, 0};
+    unsigned int m_Textures[3] = {0, 0, 0};
+
+    // tile range [first, last] covered by the screen extent of the box from -extent to +extent
+    // around center, for view depths between near and far (both in front of the camera)
+    static bool tileRange(float center, float extent, float nearDepth, float farDepth, float scale, int tiles,
+                          int &first, int &last) {
+        // x / z is monotonic in both, the extremes are at the corners
+        float lo = std::min((center - extent) / nearDepth, (center - extent) / farDepth) * scale;
+        float hi = std::max((center + extent) / nearDepth, (center + extent) / farDepth) * scale;
+        if (hi < -1.0f || lo > 1.0f)
+            return false;
+        first = std::max(0, (int) std::floor((lo * 0.5f + 0.5f) * tiles));
+        last = std::min(tiles - 1, (int) std::floor((hi * 0.5f + 0.5f) * tiles));
+        return true;
+    }
+
+    void assignSlice(unsigned int slice, float scaleX, float scaleY) {
+        const float sliceNear = m_SliceDepth[slice], sliceFar = m_SliceDepth[slice + 1];
+        uint16_t *counts = &m_CellCounts[slice * TilesX * TilesY];
+        std::fill(counts, counts + TilesX * TilesY, 0);
+        unsigned int dropped = 0;
+        for (size_t light = 0; light < m_Bounds.size(); light++) {
+            const glm::vec4 &bounds = m_Bounds[light];
+            float radius = bounds.w;
+            if (bounds.z + radius <= sliceNear || bounds.z - radius >= sliceFar)
+                continue;
+            float nearDepth = std::max(sliceNear, bounds.z - radius);
+            float farDepth = std::min(sliceFar, bounds.z + radius);
+            int x0, x1, y0, y1;
+            if (!tileRange(bounds.x, radius, nearDepth, farDepth, scaleX, TilesX, x0, x1) ||
+                !tileRange(bounds.y, radius, nearDepth, farDepth, scaleY, TilesY, y0, y1))
+                continue;
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    unsigned int tile = y * TilesX + x;
+                    if (counts[tile] == MaxLightsPerCell) {
+                        dropped++;
+                        continue;
+                    }
+                    unsigned int cell = slice * TilesX * TilesY + tile;
+                    m_CellLights[cell * MaxLightsPerCell + counts[tile]++] = (uint16_t) light;
+                }
+            }
+        }
+        m_SliceDropped[slice] = dropped;
+    }
+
+    void compact() {
+        m_Indices.clear();
+        m_Stats = Stats();
+        m_Stats.lights = (unsigned int) m_Lights.size();
+        for (int cell = 0; cell < CellCount; cell++) {
+            unsigned int count = m_CellCounts[cell];
+            m_Cells[cell * 2] = (uint32_t) m_Indices.size();
+            m_Cells[cell * 2 + 1] = count;
+            const uint16_t *lights = &m_CellLights[cell * MaxLightsPerCell];
+            m_Indices.insert(m_Indices.end(), lights, lights + count);
+            m_Stats.occupiedCells += count > 0 ? 1 : 0;
+            m_Stats.maxPerCell = std::max(m_Stats.maxPerCell, count);
+        }
+        m_Stats.assignments = (unsigned int) m_Indices.size();
+        for (unsigned int dropped : m_SliceDropped)
+            m_Stats.dropped += dropped;
+    }
+
+    void uploadBuffer(int i, const void *data, size_t size) {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr) size, data, GL_STREAM_DRAW);
+    }
+};
+
+// Light assignment for growing numbers of lights scattered through the frustum, on one thread
+// and on the job system.
+inline void benchmarkLightClusters() {
+    const int frames = 100;
+    JobSystem jobs;
+    glm::mat4 projection = glm::mat4(0.0f);
+    const float nearPlane = 0.1f, farPlane = 300.0f, focal = 1.0f / std::tan(glm::radians(22.5f));
+    projection[0][0] = focal / (16.0f / 9.0f);
+    projection[1][1] = focal;
+    projection[2][2] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+    std::cout << "Light assignment to " << LightClusters::TilesX << "x" << LightClusters::TilesY << "x"
+              << LightClusters::Slices << " clusters, " << frames << " frames, " << jobs.threadCount()
+              << " threads for the parallel run, times are per frame in ms\n";
+    BenchmarkTable table({"lights", "serial", "parallel", "assignments", "max/cell", "dropped"});
+    LightClusters clusters(nearPlane, farPlane);
+    srand(1);
+    for (int count : {64, 256, 1024, 4096}) {
+        std::vector<ClusterLight> lights;
+        for (int i = 0; i < count; i++) {
+            float depth = 2.0f + (float) (rand() % 1000) / 1000.0f * 60.0f;
+            Light light;
+            light.range = 1.0f + (float) (rand() % 100) / 100.0f * 3.0f;
+            glm::vec3 position((float) (rand() % 2001 - 1000) / 1000.0f * depth * 0.7f,
+                               (float) (rand() % 2001 - 1000) / 1000.0f * depth * 0.4f, -depth);
+            lights.push_back(ClusterLight::from(light, position, glm::vec3(0.0f, 0.0f, -1.0f)));
+        }
+        Stopwatch sw;
+        for (int frame = 0; frame < frames; frame++)
+            clusters.assign(lights, glm::mat4(1.0f), projection);
+        double serial = sw.elapsedMilliseconds() / frames;
+        sw.reset();
+        for (int frame = 0; frame < frames; frame++)
+            clusters.assign(lights, glm::mat4(1.0f), projection, &jobs);
+        double parallel = sw.elapsedMilliseconds() / frames;
+        const LightClusters::Stats &stats = clusters.stats();
+        table.row(count, serial, parallel, stats.assignments, stats.maxPerCell, stats.dropped);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_LIGHTCLUSTERS_H
@@ -0,0 +1,519 @@
+//
+// Barnes-Hut gravity for the asteroid belt, its planet and moonlets, stepped on the worker threads.
+//
+
+#ifndef PROJECT_BASE_NBODY_H
+#define PROJECT_BASE_NBODY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <rg/Benchmark.h>
+#include <rg/JobSystem.h>
+#include <rg/RadixSort.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Particles are stored as structure of arrays. step() is a kick-drift-kick leapfrog, which is
+// symplectic: the energy error oscillates instead of drifting, so orbits stay orbits over
+// long runs at a fixed step.
+//
+// Forces come from an octree rebuilt every step. The particles are sorted by the Morton code
+// of their position in the bounding cube and the arrays reordered to match, so every node is
+// a contiguous range of particles and the children of a node are next to each other. A leaf
+// holds up to LeafSize particles. The forces are worked out per group, the largest nodes of
+// up to GroupSize particles, which are shared out to the jobs: a group walks the tree once
+// for all of its particles, nodes that look small from the group's box
+// (size < theta * distance) become point masses at their centers of mass, and the leaves
+// that don't contribute their particles. The list is then summed for every particle of the
+// group, four sources at a time with SSE.
+//
+// Particles keep the id add() returned, whatever order the sort leaves them in.
+class NBody {
+public:
+    static const unsigned int LeafSize = 16;
+    static const unsigned int GroupSize = 64;
+    static const unsigned int MortonBits = 10;   // per axis, the depth limit of the tree
+
+    float G = 1.0f;
+    float theta = 0.5f;        // opening angle, smaller is more accurate and slower
+    float softening = 0.05f;   // keeps close encounters finite
+    // advance() takes whole steps of fixedStep, at most maxSteps per call
+    float fixedStep = 1.0f / 120.0f;
+    unsigned int maxSteps = 4;
+
+    struct Stats {
+        unsigned int nodes = 0;
+        unsigned int leaves = 0;
+        unsigned int groups = 0;
+        double interactions = 0.0;      // per particle, last force evaluation
+        float treeMilliseconds = 0.0f;  // bounds, sort and build
+        float forceMilliseconds = 0.0f;
+        float stepMilliseconds = 0.0f;  // all of the last step
+    };
+
+    unsigned int add(const glm::vec3 &position, const glm::vec3 &velocity, float mass) {
+        unsigned int id = size();
+        m_X.push_back(position.x);
+        m_Y.push_back(position.y);
+        m_Z.push_back(position.z);
+        m_VX.push_back(velocity.x);
+        m_VY.push_back(velocity.y);
+        m_VZ.push_back(velocity.z);
+        m_AX.push_back(0.0f);
+        m_AY.push_back(0.0f);
+        m_AZ.push_back(0.0f);
+        m_Mass.push_back(mass);
+        m_Ids.push_back(id);
+        m_Slots.push_back(id);
+        m_Accelerated = false;
+        return id;
+    }
+
+    unsigned int size() const { return (unsigned int) m_X.size(); }
+
+    glm::vec3 position(unsigned int id) const {
+        unsigned int s = m_Slots[id];
+        return glm::vec3(m_X[s], m_Y[s], m_Z[s]);
+    }
+
+    glm::vec3 velocity(unsigned int id) const {
+        unsigned int s = m_Slots[id];
+        return glm::vec3(m_VX[s], m_VY[s], m_VZ[s]);
+    }
+
+    // Collisions change velocities between steps; the positions are left to the integrator.
+    void setVelocity(unsigned int id, const glm::vec3 &velocity) {
+        unsigned int s = m_Slots[id];
+        m_VX[s] = velocity.x;
+        m_VY[s] = velocity.y;
+        m_VZ[s] = velocity.z;
+    }
+
+    float mass(unsigned int id) const { return m_Mass[m_Slots[id]]; }
+
+    // from the last force evaluation
+    glm::vec3 acceleration(unsigned int id) const {
+        unsigned int s = m_Slots[id];
+        return glm::vec3(m_AX[s], m_AY[s], m_AZ[s]);
+    }
+
+    // Direct summation over all particles, the reference for the tree's accuracy.
+    glm::vec3 directAcceleration(unsigned int id) const {
+        unsigned int s = m_Slots[id];
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        const float eps2 = softening * softening;
+        for (unsigned int j = 0; j < size(); j++) {
+            double dx = m_X[j] - m_X[s], dy = m_Y[j] - m_Y[s], dz = m_Z[j] - m_Z[s];
+            double r2 = dx * dx + dy * dy + dz * dz + eps2;
+            double f = m_Mass[j] / (r2 * std::sqrt(r2));
+            ax += f * dx;
+            ay += f * dy;
+            az += f * dz;
+        }
+        return (float) G * glm::vec3((float) ax, (float) ay, (float) az);
+    }
+
+    void step(float dt, JobSystem *jobs = nullptr) {
+        Stopwatch sw;
+        if (!m_Accelerated)
+            computeForces(jobs);
+        const float half = 0.5f * dt;
+        forChunks(jobs, size(), Chunks, [this, dt, half](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                m_VX[i] += m_AX[i] * half;
+                m_VY[i] += m_AY[i] * half;
+                m_VZ[i] += m_AZ[i] * half;
+                m_X[i] += m_VX[i] * dt;
+                m_Y[i] += m_VY[i] * dt;
+                m_Z[i] += m_VZ[i] * dt;
+            }
+        });
+        computeForces(jobs);
+        forChunks(jobs, size(), Chunks, [this, half](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                m_VX[i] += m_AX[i] * half;
+                m_VY[i] += m_AY[i] * half;
+                m_VZ[i] += m_AZ[i] * half;
+            }
+        });
+        m_Stats.stepMilliseconds = (float) sw.elapsedMilliseconds();
+    }
+
+    // Steps through elapsed seconds in whole fixed steps, the remainder is carried over to the
+    // next call. Returns the steps taken; past maxSteps the simulation falls behind instead of
+    // taking ever longer frames.
+    unsigned int advance(float elapsed, JobSystem *jobs = nullptr) {
+        m_Pending = std::min(m_Pending + std::max(elapsed, 0.0f), fixedStep * (float) maxSteps);
+        unsigned int steps = 0;
+        while (m_Pending >= fixedStep) {
+            step(fixedStep, jobs);
+            m_Pending -= fixedStep;
+            steps++;
+        }
+        return steps;
+    }
+
+    const Stats &stats() const { return m_Stats; }
+
+private:
+    struct Node {
+        glm::vec3 center;
+        float halfSize;
+        glm::vec3 centerOfMass;
+        float mass;
+        unsigned int begin, end;       // particle range
+        unsigned int firstChild;
+        unsigned int childCount;       // 0 for a leaf
+    };
+
+    struct Code {
+        uint32_t code;
+        uint32_t index;
+    };
+
+    static const unsigned int Chunks = 64;
+
+    std::vector<float> m_X, m_Y, m_Z, m_VX, m_VY, m_VZ, m_AX, m_AY, m_AZ, m_Mass;
+    std::vector<unsigned int> m_Ids;     // id of the particle in each slot
+    std::vector<unsigned int> m_Slots;   // slot of each id
+    bool m_Accelerated = false;
+    float m_Pending = 0.0f;
+
+    std::vector<Code> m_Codes;
+    RadixSorter<Code> m_Sorter;
+    std::vector<float> m_Scratch;
+    std::vector<unsigned int> m_IdScratch;
+    std::vector<Node> m_Nodes;
+    std::vector<unsigned int> m_Leaves;
+    std::vector<unsigned int> m_Groups;
+    Stats m_Stats;
+
+    // the bits of v spread out to every third bit
+    static uint32_t spreadBits(uint32_t v) {
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    void computeForces(JobSystem *jobs) {
+        Stopwatch sw;
+        const unsigned int count = size();
+        m_Nodes.clear();
+        m_Leaves.clear();
+        m_Groups.clear();
+        if (count == 0)
+            return;
+
+        // bounding cube
+        glm::vec3 lows[Chunks], highs[Chunks];
+        std::fill(lows, lows + Chunks, glm::vec3(INFINITY));
+        std::fill(highs, highs + Chunks, glm::vec3(-INFINITY));
+        forChunks(jobs, count, Chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                glm::vec3 p(m_X[i], m_Y[i], m_Z[i]);
+                lows[c] = glm::min(lows[c], p);
+                highs[c] = glm::max(highs[c], p);
+            }
+        });
+        glm::vec3 low = lows[0], high = highs[0];
+        for (unsigned int c = 1; c < Chunks; c++) {
+            low = glm::min(low, lows[c]);
+            high = glm::max(high, highs[c]);
+        }
+        glm::vec3 center = 0.5f * (low + high);
+        float halfSize = std::max(0.5f * std::max(high.x - low.x, std::max(high.y - low.y, high.z - low.z)), 1e-3f) * 1.001f;
+
+        // Morton order
+        m_Codes.resize(count);
+        const float cells = (float) (1u << MortonBits);
+        const glm::vec3 corner = center - glm::vec3(halfSize);
+        const float scale = cells / (2.0f * halfSize);
+        forChunks(jobs, count, Chunks, [&](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                glm::vec3 q = glm::clamp((glm::vec3(m_X[i], m_Y[i], m_Z[i]) - corner) * scale, glm::vec3(0.0f),
+                                         glm::vec3(cells - 1.0f));
+                m_Codes[i] = {spreadBits((uint32_t) q.x) | (spreadBits((uint32_t) q.y) << 1) |
+                              (spreadBits((uint32_t) q.z) << 2), i};
+            }
+        });
+        m_Sorter.sort(m_Codes, 3 * MortonBits, [](const Code &c) { return c.code; }, jobs);
+        reorder(jobs);
+
+        // the tree, children of a node stored together
+        Node root;
+        root.center = center;
+        root.halfSize = halfSize;
+        root.begin = 0;
+        root.end = count;
+        m_Nodes.push_back(root);
+        build(0, 0, false);
+        m_Stats.nodes = (unsigned int) m_Nodes.size();
+        m_Stats.leaves = (unsigned int) m_Leaves.size();
+        m_Stats.groups = (unsigned int) m_Groups.size();
+        m_Stats.treeMilliseconds = (float) sw.elapsedMilliseconds();
+
+        sw.reset();
+        std::atomic<uint64_t> interactions(0);
+        auto forces = [&](unsigned int first, unsigned int last) {
+            std::vector<float> sources[4];
+            std::vector<unsigned int> stack;
+            uint64_t local = 0;
+            for (unsigned int g = first; g < last; g++) {
+                const Node &group = m_Nodes[m_Groups[g]];
+                gatherSources(group, sources, stack);
+                sumForces(group.begin, group.end, sources);
+                local += (uint64_t) (group.end - group.begin) * sources[0].size();
+            }
+            interactions += local;
+        };
+        if (jobs)
+            jobs->parallelFor((unsigned int) m_Groups.size(), 8, forces);
+        else
+            forces(0, (unsigned int) m_Groups.size());
+        m_Stats.interactions = (double) interactions.load() / count;
+        m_Stats.forceMilliseconds = (float) sw.elapsedMilliseconds();
+        m_Accelerated = true;
+    }
+
+    // every particle array into Morton order
+    void reorder(JobSystem *jobs) {
+        const unsigned int count = size();
+        m_Scratch.resize(count);
+        std::vector<float> *arrays[] = {&m_X, &m_Y, &m_Z, &m_VX, &m_VY, &m_VZ, &m_AX, &m_AY, &m_AZ, &m_Mass};
+        for (std::vector<float> *array : arrays) {
+            const float *source = array->data();
+            float *target = m_Scratch.data();
+            forChunks(jobs, count, Chunks, [&](unsigned int, unsigned int begin, unsigned int end) {
+                for (unsigned int i = begin; i < end; i++)
+                    target[i] = source[m_Codes[i].index];
+            });
+            array->swap(m_Scratch);
+        }
+        m_IdScratch.resize(count);
+        forChunks(jobs, count, Chunks, [&](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                m_IdScratch[i] = m_Ids[m_Codes[i].index];
+                m_Slots[m_IdScratch[i]] = i;
+            }
+        });
+        m_Ids.swap(m_IdScratch);
+    }
+
+    // Splits a node by the next three bits of its particles' codes, then sums up its mass.
+    void build(unsigned int index, unsigned int level, bool inGroup) {
+        const unsigned int begin = m_Nodes[index].begin, end = m_Nodes[index].end;
+        if (!inGroup && end - begin <= GroupSize) {
+            m_Groups.push_back(index);
+            inGroup = true;
+        }
+        if (end - begin <= LeafSize || level == MortonBits) {
+            double mass = 0.0, x = 0.0, y = 0.0, z = 0.0;
+            for (unsigned int i = begin; i < end; i++) {
+                mass += m_Mass[i];
+                x += (double) m_Mass[i] * m_X[i];
+                y += (double) m_Mass[i] * m_Y[i];
+                z += (double) m_Mass[i] * m_Z[i];
+            }
+            Node &node = m_Nodes[index];
+            node.mass = (float) mass;
+            node.centerOfMass = mass > 0.0 ? glm::vec3((float) (x / mass), (float) (y / mass), (float) (z / mass)) : node.center;
+            node.firstChild = 0;
+            node.childCount = 0;
+            m_Leaves.push_back(index);
+            return;
+        }
+
+        const unsigned int shift = 3 * (MortonBits - 1 - level);
+        const glm::vec3 center = m_Nodes[index].center;
+        const float childHalf = 0.5f * m_Nodes[index].halfSize;
+        const unsigned int firstChild = (unsigned int) m_Nodes.size();
+        unsigned int childBegin = begin;
+        for (uint32_t octant = 0; octant < 8 && childBegin < end; octant++) {
+            // codes within the node share the bits above shift, so the octants come in order
+            unsigned int childEnd = (unsigned int) (std::partition_point(
+                    m_Codes.begin() + childBegin, m_Codes.begin() + end,
+                    [shift, octant](const Code &c) { return ((c.code >> shift) & 7u) <= octant; }) - m_Codes.begin());
+            if (childEnd == childBegin)
+                continue;
+            Node child;
+            child.center = center + childHalf * glm::vec3(octant & 1u ? 1.0f : -1.0f, octant & 2u ? 1.0f : -1.0f,
+                                                          octant & 4u ? 1.0f : -1.0f);
+            child.halfSize = childHalf;
+            child.begin = childBegin;
+            child.end = childEnd;
+            m_Nodes.push_back(child);
+            childBegin = childEnd;
+        }
+        const unsigned int childCount = (unsigned int) m_Nodes.size() - firstChild;
+        m_Nodes[index].firstChild = firstChild;
+        m_Nodes[index].childCount = childCount;
+
+        float mass = 0.0f;
+        glm::vec3 moment(0.0f);
+        for (unsigned int c = firstChild; c < firstChild + childCount; c++) {
+            build(c, level + 1, inGroup);
+            mass += m_Nodes[c].mass;
+            moment += m_Nodes[c].mass * m_Nodes[c].centerOfMass;
+        }
+        Node &node = m_Nodes[index];
+        node.mass = mass;
+        node.centerOfMass = mass > 0.0f ? moment / mass : node.center;
+    }
+
+    // The interaction list of a group as x, y, z and mass arrays, padded to a multiple of four
+    // with massless sources.
+    void gatherSources(const Node &group, std::vector<float> (&sources)[4], std::vector<unsigned int> &stack) const {
+        for (std::vector<float> &source : sources)
+            source.clear();
+        const float theta2 = theta * theta;
+        auto push = [&sources](float x, float y, float z, float m) {
+            sources[0].push_back(x);
+            sources[1].push_back(y);
+            sources[2].push_back(z);
+            sources[3].push_back(m);
+        };
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty()) {
+            unsigned int index = stack.back();
+            stack.pop_back();
+            const Node &node = m_Nodes[index];
+            // from the nearest point of the group's box, nodes overlapping it are always opened
+            glm::vec3 d = glm::max(glm::abs(node.centerOfMass - group.center) - glm::vec3(group.halfSize), glm::vec3(0.0f));
+            float size = 2.0f * node.halfSize;
+            if (size * size < theta2 * glm::dot(d, d)) {
+                push(node.centerOfMass.x, node.centerOfMass.y, node.centerOfMass.z, node.mass);
+                continue;
+            }
+            if (node.childCount == 0) {
+                for (unsigned int i = node.begin; i < node.end; i++)
+                    push(m_X[i], m_Y[i], m_Z[i], m_Mass[i]);
+                continue;
+            }
+            for (unsigned int c = node.firstChild; c < node.firstChild + node.childCount; c++)
+                stack.push_back(c);
+        }
+        while (sources[0].size() % 4)
+            push(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    // Accelerations of the particles in [begin, end) from the sources; a particle's own entry
+    // adds nothing, its offset is zero.
+    void sumForces(unsigned int begin, unsigned int end, const std::vector<float> (&sources)[4]) {
+        const float *sx = sources[0].data(), *sy = sources[1].data(), *sz = sources[2].data(), *sm = sources[3].data();
+        const unsigned int count = (unsigned int) sources[0].size();
+        const float eps2 = softening * softening;
+        for (unsigned int i = begin; i < end; i++) {
+            float ax, ay, az;
+#if defined(__SSE2__)
+            const __m128 xi = _mm_set1_ps(m_X[i]), yi = _mm_set1_ps(m_Y[i]), zi = _mm_set1_ps(m_Z[i]);
+            const __m128 soft = _mm_set1_ps(eps2), half = _mm_set1_ps(0.5f), threeHalves = _mm_set1_ps(1.5f);
+            __m128 sumX = _mm_setzero_ps(), sumY = _mm_setzero_ps(), sumZ = _mm_setzero_ps();
+            for (unsigned int j = 0; j < count; j += 4) {
+                __m128 dx = _mm_sub_ps(_mm_loadu_ps(sx + j), xi);
+                __m128 dy = _mm_sub_ps(_mm_loadu_ps(sy + j), yi);
+                __m128 dz = _mm_sub_ps(_mm_loadu_ps(sz + j), zi);
+                __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), soft));
+                // the 12 bit estimate and one Newton step
+                __m128 inv = _mm_rsqrt_ps(r2);
+                inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv, inv))));
+                __m128 f = _mm_mul_ps(_mm_loadu_ps(sm + j), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+                sumX = _mm_add_ps(sumX, _mm_mul_ps(f, dx));
+                sumY = _mm_add_ps(sumY, _mm_mul_ps(f, dy));
+                sumZ = _mm_add_ps(sumZ, _mm_mul_ps(f, dz));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, sumX);
+            ax = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            _mm_storeu_ps(lanes, sumY);
+            ay = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            _mm_storeu_ps(lanes, sumZ);
+            az = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+            ax = ay = az = 0.0f;
+            for (unsigned int j = 0; j < count; j++) {
+                float dx = sx[j] - m_X[i], dy = sy[j] - m_Y[i], dz = sz[j] - m_Z[i];
+                float r2 = dx * dx + dy * dy + dz * dz + eps2;
+                float inv = 1.0f / std::sqrt(r2);
+                float f = sm[j] * inv * inv * inv;
+                ax += f * dx;
+                ay += f * dy;
+                az += f * dz;
+            }
+#endif
+            m_AX[i] = G * ax;
+            m_AY[i] = G * ay;
+            m_AZ[i] = G * az;
+        }
+    }
+};
+
+// A planet with count particles in a belt around it on circular orbits, speed sqrt(G M / r).
+inline void addBelt(NBody &bodies, unsigned int count, float planetMass, float radius, float width, float height) {
+    bodies.add(glm::vec3(0.0f), glm::vec3(0.0f), planetMass);
+    for (unsigned int i = 0; i < count; i++) {
+        float angle = 2.0f * glm::pi<float>() * (float) rand() / (float) RAND_MAX;
+        float r = radius + width * ((float) rand() / (float) RAND_MAX - 0.5f);
+        float y = height * ((float) rand() / (float) RAND_MAX - 0.5f);
+        glm::vec3 position(r * std::cos(angle), y, r * std::sin(angle));
+        float distance = glm::length(position);
+        float speed = std::sqrt(bodies.G * planetMass / distance) * r / distance;
+        bodies.add(position, speed * glm::vec3(-std::sin(angle), 0.0f, std::cos(angle)), 1e-3f);
+    }
+}
+
+// Belts of growing size: tree and force times per step with the job system and on one
+// thread, interactions per particle and the RMS force error against direct summation.
+inline void benchmarkNBody() {
+    JobSystem jobs;
+    std::cout << "Barnes-Hut belt, theta 0.5, leaves of " << NBody::LeafSize << ", " << jobs.threadCount()
+              << " threads, times are per step in ms\n";
+    BenchmarkTable table({"particles", "tree", "forces", "step", "1 thread", "inter/part", "error %"});
+    srand(1);
+    for (unsigned int count : {10000u, 100000u, 1000000u}) {
+        NBody bodies;
+        addBelt(bodies, count, 720.0f, 20.0f, 6.0f, 2.0f);
+        const int steps = std::max(1, (int) (200000 / count));
+        bodies.step(bodies.fixedStep, &jobs);
+        Stopwatch sw;
+        double tree = 0.0, forces = 0.0;
+        for (int s = 0; s < steps; s++) {
+            bodies.step(bodies.fixedStep, &jobs);
+            tree += bodies.stats().treeMilliseconds;
+            forces += bodies.stats().forceMilliseconds;
+        }
+        double parallel = sw.elapsedMilliseconds() / steps;
+        sw.reset();
+        bodies.step(bodies.fixedStep);
+        double serial = sw.elapsedMilliseconds();
+
+        // belt particles only, the planet itself feels next to nothing
+        double error = 0.0, reference = 0.0;
+        const unsigned int samples = 256;
+        for (unsigned int s = 0; s < samples; s++) {
+            unsigned int id = 1 + (unsigned int) ((uint64_t) s * count / samples);
+            glm::vec3 exact = bodies.directAcceleration(id);
+            glm::vec3 difference = bodies.acceleration(id) - exact;
+            error += glm::dot(difference, difference);
+            reference += glm::dot(exact, exact);
+        }
+        table.row(count, tree / steps, forces / steps, parallel, serial, bodies.stats().interactions,
+                  100.0 * std::sqrt(error / reference));
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_NBODY_H
@@ -0,0 +1,297 @@
+//
+// Low resolution CPU depth rasterizer and hierarchical depth test for occlusion culling.
+//
+
+#ifndef PROJECT_BASE_OCCLUSIONCULLING_H
+#define PROJECT_BASE_OCCLUSIONCULLING_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/Benchmark.h>
+#include <rg/SpatialIndex.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+
+// Simplified, closed geometry drawn into the depth buffer in place of the real model.
+// It has to stay inside the object it stands for, or it would hide things that are visible.
+struct OccluderMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+
+    // UV sphere with vertices on the surface, so the faceted hull is inscribed in the real sphere.
+    // Triangles wind counter-clockwise when seen from outside.
+    static OccluderMesh sphere(float radius, int rings, int segments) {
+        OccluderMesh mesh;
+        for (int r = 0; r <= rings; r++) {
+            float phi = glm::pi<float>() * (float)r / (float)rings;
+            for (int s = 0; s <= segments; s++) {
+                float theta = 2.0f * glm::pi<float>() * (float)s / (float)segments;
+                mesh.vertices.push_back(radius * glm::vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta)));
+            }
+        }
+        for (int r = 0; r < rings; r++) {
+            for (int s = 0; s < segments; s++) {
+                unsigned int a = r * (segments + 1) + s;
+                unsigned int b = a + segments + 1;
+                if (r != 0) {
+                    mesh.indices.push_back(a);
+                    mesh.indices.push_back(a + 1);
+                    mesh.indices.push_back(b);
+                }
+                if (r != rings - 1) {
+                    mesh.indices.push_back(a + 1);
+                    mesh.indices.push_back(b + 1);
+                    mesh.indices.push_back(b);
+                }
+            }
+        }
+        return mesh;
+    }
+};
+
+// Depth buffer holds window space depth in [0, 1] like the GL one, 1 is the far plane.
+// Each hierarchy level keeps the farthest depth of the 2x2 texels below it, so a box
+// whose nearest point is behind a texel of some level is behind everything it covers.
+class DepthRasterizer {
+public:
+    unsigned int trianglesDrawn = 0;
+    unsigned int boxesTested = 0;
+    unsigned int boxesOccluded = 0;
+
+    DepthRasterizer(int width = 320, int height = 180) {
+        resize(width, height);
+    }
+
+    // Width is rounded up to a multiple of 4 so rows can be processed four pixels at a time.
+    void resize(int width, int height) {
+        m_Width = (std::max(width, 4) + 3) & ~3;
+        m_Height = std::max(height, 1);
+        m_Levels.clear();
+        int w = m_Width, h = m_Height;
+        for (;;) {
+            m_Levels.push_back(Level{w, h, std::vector<float>((size_t)w * h, 1.0f)});
+            if (w == 1 && h == 1)
+                break;
+            w = std::max(1, (w + 1) / 2);
+            h = std::max(1, (h + 1) / 2);
+        }
+    }
+
+    void clear() {
+        std::fill(m_Levels[0].depth.begin(), m_Levels[0].depth.end(), 1.0f);
+        trianglesDrawn = boxesTested = boxesOccluded = 0;
+    }
+
+    void setViewProjection(const glm::mat4 &viewProjection) {
+        m_ViewProjection = viewProjection;
+    }
+
+    void drawMesh(const OccluderMesh &mesh, const glm::mat4 &model) {
+        glm::mat4 mvp = m_ViewProjection * model;
+        m_Clip.resize(mesh.vertices.size());
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+            m_Clip[i] = mvp * glm::vec4(mesh.vertices[i], 1.0f);
+
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const glm::vec4 &a = m_Clip[mesh.indices[i]];
+            const glm::vec4 &b = m_Clip[mesh.indices[i + 1]];
+            const glm::vec4 &c = m_Clip[mesh.indices[i + 2]];
+            // occluders are optional, so triangles crossing the near plane are just dropped
+            if (a.z < -a.w || b.z < -b.w || c.z < -c.w)
+                continue;
+            rasterizeTriangle(toWindow(a), toWindow(b), toWindow(c));
+        }
+    }
+
+    void buildHierarchy() {
+        for (unsigned int l = 1; l < m_Levels.size(); l++) {
+            const Level &src = m_Levels[l - 1];
+            Level &dst = m_Levels[l];
+            for (int y = 0; y < dst.height; y++) {
+                int y0 = std::min(2 * y, src.height - 1);
+                int y1 = std::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; x++) {
+                    int x0 = std::min(2 * x, src.width - 1);
+                    int x1 = std::min(2 * x + 1, src.width - 1);
+                    dst.depth[y * dst.width + x] = std::max(
+                            std::max(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+                            std::max(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1]));
+                }
+            }
+        }
+    }
+
+    // Conservative: anything touching the near plane or the screen edge counts as visible.
+    bool isVisible(const AABB &box) {
+        boxesTested++;
+        glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        // corners are the min corner plus combinations of the three transformed box edges
+        glm::vec4 origin = m_ViewProjection * glm::vec4(box.min, 1.0f);
+        glm::vec3 size = box.max - box.min;
+        glm::vec4 edgeX = m_ViewProjection[0] * size.x;
+        glm::vec4 edgeY = m_ViewProjection[1] * size.y;
+        glm::vec4 edgeZ = m_ViewProjection[2] * size.z;
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 clip = origin;
+            if (i & 1) clip += edgeX;
+            if (i & 2) clip += edgeY;
+            if (i & 4) clip += edgeZ;
+            if (clip.z < -clip.w)
+                return true;
+            glm::vec3 window = toWindow(clip);
+            lo = glm::min(lo, window);
+            hi = glm::max(hi, window);
+        }
+        int x0 = std::max(0, (int)lo.x), y0 = std::max(0, (int)lo.y);
+        int x1 = std::min(m_Width - 1, (int)hi.x), y1 = std::min(m_Height - 1, (int)hi.y);
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        // coarsest level where the rectangle spans at most 2x2 texels
+        unsigned int level = 0;
+        while (level + 1 < m_Levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        const Level &l = m_Levels[level];
+        for (int y = y0 >> level; y <= std::min(y1 >> level, l.height - 1); y++) {
+            for (int x = x0 >> level; x <= std::min(x1 >> level, l.width - 1); x++) {
+                if (lo.z <= l.depth[y * l.width + x])
+                    return true;
+            }
+        }
+        boxesOccluded++;
+        return false;
+    }
+
+    int width() const { return m_Width; }
+    int height() const { return m_Height; }
+    const float *depth(unsigned int level = 0) const { return m_Levels[level].depth.data(); }
+
+private:
+    struct Level {
+        int width, height;
+        std::vector<float> depth;
+    };
+
+    int m_Width = 0, m_Height = 0;
+    std::vector<Level> m_Levels;
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> m_Clip;
+
+    glm::vec3 toWindow(const glm::vec4 &clip) const {
+        float invW = 1.0f / clip.w;
+        return glm::vec3((clip.x * invW * 0.5f + 0.5f) * (float)m_Width,
+                         (clip.y * invW * 0.5f + 0.5f) * (float)m_Height,
+                         clip.z * invW * 0.5f + 0.5f);
+    }
+
+    void rasterizeTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2) {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (area <= 0.0f)
+            return;   // back facing or degenerate
+        int minX = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        int maxX = std::min(m_Width - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        int minY = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        int maxY = std::min(m_Height - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        if (minX > maxX || minY > maxY)
+            return;
+        trianglesDrawn++;
+
+        // edge functions e(x, y) = a * x + b * y + c, positive inside
+        float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v2.x * v1.y;
+        float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v0.x * v2.y;
+        float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v1.x * v0.y;
+        // depth is affine in window space
+        float invArea = 1.0f / area;
+        float dzdx = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * invArea;
+        float dzdy = (b0 * v0.z + b1 * v1.z + b2 * v2.z) * invArea;
+        float z0 = (c0 * v0.z + c1 * v1.z + c2 * v2.z) * invArea;
+
+        std::vector<float> &depth = m_Levels[0].depth;
+        minX &= ~3;
+        for (int y = minY; y <= maxY; y++) {
+            float py = (float)y + 0.5f;
+            float *row = &depth[(size_t)y * m_Width];
+#if defined(__SSE2__)
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), _mm_set1_ps(b0 * py + c0));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), _mm_set1_ps(b1 * py + c1));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), _mm_set1_ps(b2 * py + c2));
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + z0));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                         _mm_and_ps(_mm_cmpge_ps(e2, zero), _mm_cmplt_ps(z, old)));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old)));
+            }
+#else
+            for (int x = minX; x <= maxX && x < m_Width; x++) {
+                float px = (float)x + 0.5f;
+                if (a0 * px + (b0 * py + c0) < 0.0f || a1 * px + (b1 * py + c1) < 0.0f || a2 * px + (b2 * py + c2) < 0.0f)
+                    continue;
+                float z = dzdx * px + (dzdy * py + z0);
+                if (z < row[x])
+                    row[x] = z;
+            }
+#endif
+        }
+    }
+};
+
+// Camera just behind Saturn, looking through it at the belt on the far side.
+inline void benchmarkOcclusionCulling() {
+    const int frames = 100;
+    const glm::vec3 saturn(100.0f, 0.0f, 0.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    glm::mat4 view = glm::lookAt(saturn - glm::vec3(0.0f, 0.0f, 12.0f), saturn, glm::vec3(0.0f, 1.0f, 0.0f));
+    OccluderMesh sphere = OccluderMesh::sphere(1.0f, 12, 16);
+    glm::mat4 saturnModel = glm::scale(glm::translate(glm::mat4(1.0f), saturn), glm::vec3(8.0f));
+    glm::mat4 sunModel = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f));
+
+    std::cout << "Occlusion culling at 320x180, " << frames << " frames, times are per frame in ms\n";
+    BenchmarkTable table({"boxes", "raster", "hierarchy", "test", "occluded"});
+    for (int count : {1000, 10000, 100000}) {
+        srand(42);
+        std::vector<AABB> boxes(count);
+        for (int i = 0; i < count; i++) {
+            float a = 2.0f * glm::pi<float>() * (float)i / (float)count;
+            float r = 20.0f + (float)(rand() % 7 - 3);
+            boxes[i] = AABB::fromSphere(saturn + glm::vec3(r * cos(a), (float)(rand() % 3 - 1), r * sin(a)), 0.7f);
+        }
+        DepthRasterizer rasterizer;
+        double raster = 0.0, hierarchy = 0.0, test = 0.0;
+        unsigned int occluded = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            Stopwatch sw;
+            rasterizer.clear();
+            rasterizer.setViewProjection(projection * view);
+            rasterizer.drawMesh(sphere, saturnModel);
+            rasterizer.drawMesh(sphere, sunModel);
+            raster += sw.elapsedMilliseconds();
+
+            sw.reset();
+            rasterizer.buildHierarchy();
+            hierarchy += sw.elapsedMilliseconds();
+
+            sw.reset();
+            for (const AABB &box : boxes)
+                rasterizer.isVisible(box);
+            test += sw.elapsedMilliseconds();
+            occluded = rasterizer.boxesOccluded;
+        }
+        table.row(count, raster / frames, hierarchy / frames, test / frames, occluded);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_OCCLUSIONCULLING_H
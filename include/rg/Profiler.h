@@ -0,0 +1,284 @@
+//
+// Nested CPU and GPU timings of named scopes, kept over the last few hundred frames.
+//
+
+#ifndef PROJECT_BASE_PROFILER_H
+#define PROJECT_BASE_PROFILER_H
+
+#include <glad/glad.h>
+#include <rg/Benchmark.h>
+#include <rg/Error.h>
+#include <rg/TraceRecorder.h>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// A Scope times the code between its construction and destruction: CPU time with a
+// stopwatch and, unless it is CPU only, GPU time with a GL_TIMESTAMP query on each side.
+// Timestamps rather than GL_TIME_ELAPSED pairs, because elapsed queries can't nest and
+// DynamicResolution keeps one open around the whole frame. Scopes opened inside another
+// one become its children, and everything between beginFrame() and endFrame() is under the
+// root "frame" scope. A scope that runs several times in a frame adds up.
+//
+// Queries are double buffered: the queries of a frame are read when their buffer comes
+// around again at the start of the frame after next, by which time the GPU is normally done
+// with them. If it isn't, that frame's GPU times are dropped rather than waited for.
+//
+// With a trace recorder set, scopes and GPU times also go to the capture it is running.
+class Profiler {
+public:
+    static const unsigned int HistorySize = 240;
+
+    TraceRecorder *trace = nullptr;
+
+    struct Section {
+        std::string name;
+        int parent;
+        int depth;
+        bool gpu;
+        // rolling histories, the newest sample at index next - 1; negative where nothing was
+        // measured, and a GPU time stays so until its queries are read, or if they are dropped
+        std::vector<float> cpuMilliseconds;
+        std::vector<float> gpuMilliseconds;
+        unsigned int next = 0;
+        unsigned int lastFrame = 0;
+
+        unsigned int newest() const { return (next + HistorySize - 1) % HistorySize; }
+    };
+
+    class Scope {
+    public:
+        Scope(Profiler &profiler, const char *name, bool gpu = true)
+                : m_Profiler(profiler), m_Depth(profiler.push(name, gpu)) {}
+
+        ~Scope() {
+            m_Profiler.pop(m_Depth);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Profiler &m_Profiler;
+        size_t m_Depth;
+    };
+
+    Profiler()
+            : m_FrameMilliseconds(HistorySize, -1.0f) {}
+
+    ~Profiler() {
+        for (Buffer &buffer : m_Buffers) {
+            if (!buffer.queries.empty())
+                glDeleteQueries((GLsizei) buffer.queries.size(), buffer.queries.data());
+        }
+    }
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    void beginFrame() {
+        if (m_Frame > 0) {
+            m_FrameMilliseconds[m_NextFrame] = (float) m_FrameClock.elapsedMilliseconds();
+            m_NextFrame = (m_NextFrame + 1) % HistorySize;
+        }
+        m_FrameClock.reset();
+        m_Frame++;
+        if (trace) {
+            if (trace->needsCalibration()) {
+                GLint64 gpuTime = 0;
+                glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+                trace->calibrate(gpuTime);
+            }
+            trace->beginFrame(m_Frame);
+        }
+        resolve(buffer());
+        buffer().frame = m_Frame;
+        buffer().usedQueries = 0;
+        buffer().records.clear();
+        push("frame", true);
+    }
+
+    void endFrame() {
+        pop(1);
+        ASSERT(m_Open.empty(), "Profiler scope still open at the end of the frame!");
+    }
+
+    const std::vector<Section> &sections() const { return m_Sections; }
+    // indices into sections(), every parent directly followed by its subtree
+    const std::vector<int> &treeOrder() const { return m_TreeOrder; }
+
+    // Time from one beginFrame() to the next, everything outside the frame scope included.
+    // Oldest first starting at index frameHistoryOffset(), the way ImGui::PlotLines takes it.
+    const std::vector<float> &frameMilliseconds() const { return m_FrameMilliseconds; }
+    unsigned int frameHistoryOffset() const { return m_NextFrame; }
+    unsigned int droppedFrames() const { return m_Dropped; }
+
+    // Mean over the history, leaving out samples that weren't measured.
+    static float average(const std::vector<float> &history) {
+        float sum = 0.0f;
+        unsigned int count = 0;
+        for (float v : history) {
+            if (v >= 0.0f) {
+                sum += v;
+                count++;
+            }
+        }
+        return count ? sum / (float) count : 0.0f;
+    }
+
+    // Average times of every section, indented under its parent.
+    void print(std::ostream &out) const {
+        out << std::left << std::setw(24) << "scope" << std::right << std::setw(10) << "cpu ms" << std::setw(10)
+            << "gpu ms" << '\n' << std::fixed << std::setprecision(3);
+        for (int i : m_TreeOrder) {
+            const Section &section = m_Sections[i];
+            out << std::left << std::setw(24) << std::string(2 * section.depth, ' ') + section.name << std::right
+                << std::setw(10) << average(section.cpuMilliseconds);
+            if (section.gpu)
+                out << std::setw(10) << average(section.gpuMilliseconds);
+            out << '\n';
+        }
+        if (m_Dropped)
+            out << m_Dropped << " frames without GPU times, their queries weren't ready\n";
+        out << std::defaultfloat << std::flush;
+    }
+
+private:
+    struct Open {
+        int section;
+        int query;   // the first of two, -1 for a CPU only scope
+        bool traced;
+        Stopwatch clock;
+    };
+
+    struct Record {
+        int section;
+        int query;
+        unsigned int slot;   // history index the GPU time goes into
+    };
+
+    struct Buffer {
+        unsigned int frame = 0;
+        std::vector<unsigned int> queries;
+        unsigned int usedQueries = 0;
+        std::vector<Record> records;
+    };
+
+    std::vector<Section> m_Sections;
+    std::vector<int> m_TreeOrder;
+    std::vector<Open> m_Open;
+    Buffer m_Buffers[2];
+    unsigned int m_Frame = 0;
+    unsigned int m_Dropped = 0;
+
+    std::vector<float> m_FrameMilliseconds;
+    unsigned int m_NextFrame = 0;
+    Stopwatch m_FrameClock;
+
+    Buffer &buffer() { return m_Buffers[m_Frame % 2]; }
+
+    int findSection(const char *name, int parent, bool gpu) {
+        for (unsigned int i = 0; i < m_Sections.size(); i++) {
+            if (m_Sections[i].parent == parent && m_Sections[i].name == name)
+                return (int) i;
+        }
+        Section section;
+        section.name = name;
+        section.parent = parent;
+        section.depth = parent < 0 ? 0 : m_Sections[parent].depth + 1;
+        section.gpu = gpu;
+        section.cpuMilliseconds.assign(HistorySize, -1.0f);
+        section.gpuMilliseconds.assign(HistorySize, -1.0f);
+        m_Sections.push_back(section);
+        int index = (int) m_Sections.size() - 1;
+
+        // after the parent's subtree, which is everything following it that's deeper
+        unsigned int at = 0;
+        if (parent >= 0) {
+            while (m_TreeOrder[at] != parent)
+                at++;
+            at++;
+            while (at < m_TreeOrder.size() && m_Sections[m_TreeOrder[at]].depth > m_Sections[parent].depth)
+                at++;
+        }
+        else {
+            at = (unsigned int) m_TreeOrder.size();
+        }
+        m_TreeOrder.insert(m_TreeOrder.begin() + at, index);
+        return index;
+    }
+
+    // Returns the depth of the new scope, which pop() checks so a scope can only close once
+    // everything opened inside it has: one closed early would end its parent's time instead.
+    size_t push(const char *name, bool gpu) {
+        int parent = m_Open.empty() ? -1 : m_Open.back().section;
+        int query = -1;
+        if (gpu) {
+            Buffer &b = buffer();
+            if (b.usedQueries + 2 > b.queries.size()) {
+                b.queries.resize(b.queries.size() + 16);
+                glGenQueries(16, b.queries.data() + b.queries.size() - 16);
+            }
+            query = (int) b.usedQueries;
+            b.usedQueries += 2;
+            glQueryCounter(b.queries[query], GL_TIMESTAMP);
+        }
+        bool traced = trace && trace->recording();
+        if (traced)
+            trace->begin(name);
+        m_Open.push_back({findSection(name, parent, gpu), query, traced, Stopwatch()});
+        return m_Open.size();
+    }
+
+    void pop(size_t depth) {
+        ASSERT(!m_Open.empty(), "Profiler scope closed that was never opened!");
+        ASSERT(m_Open.size() == depth, "Profiler scope closed before a scope opened inside it!");
+        Open open = m_Open.back();
+        m_Open.pop_back();
+        if (open.traced)
+            trace->end();
+        Section &section = m_Sections[open.section];
+        if (section.lastFrame != m_Frame) {
+            section.lastFrame = m_Frame;
+            section.cpuMilliseconds[section.next] = 0.0f;
+            section.gpuMilliseconds[section.next] = -1.0f;
+            section.next = (section.next + 1) % HistorySize;
+        }
+        section.cpuMilliseconds[section.newest()] += (float) open.clock.elapsedMilliseconds();
+        if (open.query >= 0) {
+            Buffer &b = buffer();
+            glQueryCounter(b.queries[open.query + 1], GL_TIMESTAMP);
+            b.records.push_back({open.section, open.query, section.newest()});
+        }
+    }
+
+    // Reads the GPU times of the frame that last used the buffer, if the end of its frame
+    // scope, the last query it issued, is available; queries complete in order, so then all
+    // of them are.
+    void resolve(Buffer &b) {
+        if (b.records.empty())
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(b.queries[b.records.back().query + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            m_Dropped++;
+            return;
+        }
+        for (const Record &record : b.records) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(b.queries[record.query], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(b.queries[record.query + 1], GL_QUERY_RESULT, &end);
+            float &sample = m_Sections[record.section].gpuMilliseconds[record.slot];
+            sample = (sample < 0.0f ? 0.0f : sample) + (float) ((end - begin) / 1.0e6);
+            if (trace)
+                trace->gpuScope(m_Sections[record.section].name, b.frame, begin, end);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_PROFILER_H
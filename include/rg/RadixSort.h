@@ -0,0 +1,97 @@
+//
+// Stable LSD radix sort of items by an unsigned integer key, serial or on the worker threads.
+//
+
+#ifndef PROJECT_BASE_RADIXSORT_H
+#define PROJECT_BASE_RADIXSORT_H
+
+#include <rg/JobSystem.h>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Sorts by the low bits of a key, 8 bits a pass, and skips the passes over a byte every key
+// shares. The sort is stable, so items with equal keys stay in the order they came in, and
+// the result is the same whatever the thread count.
+//
+// On the jobs, every chunk counts the digits of its own range and scatters it to where the
+// counts of the chunks before it end. Serially there is one chunk, and the counts of all the
+// passes are taken in a single pass over the keys.
+template<typename Item>
+class RadixSorter {
+public:
+    // keyOf(item) returns the key, of which the low bits are sorted by
+    template<typename KeyOf>
+    void sort(std::vector<Item> &items, unsigned int bits, KeyOf keyOf, JobSystem *jobs = nullptr) {
+        typedef decltype(keyOf(items[0])) Key;
+        const unsigned int count = (unsigned int) items.size();
+        if (count < 2)
+            return;
+        const unsigned int passes = std::min((bits + 7) / 8, (unsigned int) sizeof(Key));
+        // up to 64 chunks of at least 4096 items, smaller ones cost more to count than to scatter
+        const unsigned int chunks = jobs ? std::max(1u, std::min(64u, count / 4096)) : 1u;
+        m_Scratch.resize(count);
+        m_Counts.assign((size_t) chunks * passes * 256, 0u);
+
+        // the counts of every pass in the items' first order, correct for the first pass
+        // made, and with one chunk for all of them
+        forChunks(jobs, count, chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            uint32_t *counts = &m_Counts[(size_t) c * passes * 256];
+            for (unsigned int i = begin; i < end; i++) {
+                Key key = keyOf(items[i]);
+                for (unsigned int pass = 0; pass < passes; pass++)
+                    counts[pass * 256 + ((key >> (pass * 8)) & 0xFF)]++;
+            }
+        });
+
+        Item *from = items.data(), *to = m_Scratch.data();
+        bool moved = false;
+        for (unsigned int pass = 0; pass < passes; pass++) {
+            const unsigned int shift = pass * 8;
+            const unsigned int firstDigit = (unsigned int) ((keyOf(from[0]) >> shift) & 0xFF);
+            uint32_t sameDigit = 0;
+            for (unsigned int c = 0; c < chunks; c++)
+                sameDigit += m_Counts[((size_t) c * passes + pass) * 256 + firstDigit];
+            if (sameDigit == count)
+                continue;
+            if (moved && chunks > 1) {
+                // the chunks hold other items than when they were counted
+                forChunks(jobs, count, chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+                    uint32_t *counts = &m_Counts[((size_t) c * passes + pass) * 256];
+                    std::fill(counts, counts + 256, 0u);
+                    for (unsigned int i = begin; i < end; i++)
+                        counts[(keyOf(from[i]) >> shift) & 0xFF]++;
+                });
+            }
+            uint32_t offset = 0;
+            for (unsigned int digit = 0; digit < 256; digit++) {
+                for (unsigned int c = 0; c < chunks; c++) {
+                    uint32_t &digitCount = m_Counts[((size_t) c * passes + pass) * 256 + digit];
+                    uint32_t next = offset + digitCount;
+                    digitCount = offset;
+                    offset = next;
+                }
+            }
+            forChunks(jobs, count, chunks, [&](unsigned int c, unsigned int begin, unsigned int end) {
+                uint32_t *offsets = &m_Counts[((size_t) c * passes + pass) * 256];
+                for (unsigned int i = begin; i < end; i++)
+                    to[offsets[(keyOf(from[i]) >> shift) & 0xFF]++] = from[i];
+            });
+            std::swap(from, to);
+            moved = true;
+        }
+        if (from != items.data())
+            items.swap(m_Scratch);
+    }
+
+private:
+    std::vector<Item> m_Scratch;
+    std::vector<uint32_t> m_Counts;   // chunk, pass, digit
+};
+
+}
+
+#endif //PROJECT_BASE_RADIXSORT_H
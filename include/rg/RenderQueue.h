@@ -0,0 +1,85 @@
+//
+// Draws submitted as 64-bit sort keys and radix-sorted into submission order once per frame.
+//
+
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <rg/RadixSort.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rg {
+
+// A key packs everything the order depends on, most significant first, so sorting the keys
+// as plain integers gives the order to draw in:
+//
+//   opaque   | pass 2 | pipeline 16 | material 16 | depth 24 | 6 unused |
+//   other    | pass 2 | ~depth 24   | pipeline 16 | material 16 | 6 unused |
+//
+// The pipeline is the program plus a few bits of fixed-function state, so opaque draws come
+// out grouped by program and then by material, each group front to back for early-Z. Passes
+// after the opaque one (the sky, blended geometry) are sorted back to front instead, with the
+// depth inverted.
+//
+// The value of an entry is the caller's, an index into its own list of draws. sort() is a
+// RadixSorter over the bytes of the key, which skips the bytes all keys share.
+class RenderQueue {
+public:
+    enum Pass : uint64_t {
+        Opaque = 0,
+        Sky = 1,
+        Blended = 2
+    };
+
+    struct Entry {
+        uint64_t key;
+        uint32_t value;
+    };
+
+    // program is a GL program name, state the fixed-function state it is drawn with (4 bits)
+    static uint32_t pipeline(unsigned int program, unsigned int state = 0) {
+        return ((program & 0xFFFu) << 4) | (state & 0xFu);
+    }
+
+    static uint64_t opaqueKey(uint32_t pipeline, uint32_t material, float depth) {
+        return ((uint64_t) Opaque << 62) | ((uint64_t) (pipeline & 0xFFFF) << 46) |
+               ((uint64_t) (material & 0xFFFF) << 30) | ((uint64_t) depthBits(depth) << 6);
+    }
+
+    static uint64_t backToFrontKey(Pass pass, uint32_t pipeline, uint32_t material, float depth) {
+        return ((uint64_t) pass << 62) | ((uint64_t) (~depthBits(depth) & 0xFFFFFF) << 38) |
+               ((uint64_t) (pipeline & 0xFFFF) << 22) | ((uint64_t) (material & 0xFFFF) << 6);
+    }
+
+    static Pass pass(uint64_t key) { return (Pass) (key >> 62); }
+
+    void clear() { m_Entries.clear(); }
+
+    void submit(uint64_t key, uint32_t value) { m_Entries.push_back({key, value}); }
+
+    void sort() {
+        m_Sorter.sort(m_Entries, 64, [](const Entry &entry) { return entry.key; });
+    }
+
+    const std::vector<Entry> &entries() const { return m_Entries; }
+    size_t size() const { return m_Entries.size(); }
+
+private:
+    std::vector<Entry> m_Entries;
+    RadixSorter<Entry> m_Sorter;
+
+    // the top 24 bits of a non-negative float, which order the same way the floats do
+    static uint32_t depthBits(float depth) {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 8;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERQUEUE_H
@@ -0,0 +1,257 @@
+//
+// Render targets handed out by descriptor and recycled across passes and frames.
+//
+
+#ifndef PROJECT_BASE_RENDERTARGETPOOL_H
+#define PROJECT_BASE_RENDERTARGETPOOL_H
+
+#include <glad/glad.h>
+#include <rg/Error.h>
+#include <algorithm>
+#include <vector>
+
+namespace rg {
+
+struct RenderTargetDesc {
+    int width = 0;
+    int height = 0;
+    GLenum format = GL_RGBA16F;   // sized internal format, depth formats become depth attachments
+    int samples = 1;
+
+    RenderTargetDesc() = default;
+    RenderTargetDesc(int width, int height, GLenum format, int samples = 1)
+            : width(width), height(height), format(format), samples(samples) {}
+
+    bool operator==(const RenderTargetDesc &other) const {
+        return width == other.width && height == other.height && format == other.format && samples == other.samples;
+    }
+
+    bool isDepth() const {
+        return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+               || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+};
+
+// acquire() returns a free target with an equal descriptor, or creates one. release() puts it
+// back, so a target acquired after another one's last use in the frame gets the same texture:
+// passes whose lifetimes don't overlap share memory, and the same passes get the same
+// textures again next frame. Targets nobody acquired for maxIdleFrames are deleted, which is
+// how the old sizes go away after a resize.
+class RenderTargetPool {
+public:
+    typedef int Target;
+    static const Target None = -1;
+
+    unsigned int maxIdleFrames = 3;
+    // textures created during the current frame, 0 once the pool has warmed up
+    unsigned int allocationsThisFrame = 0;
+
+    RenderTargetPool() = default;
+
+    ~RenderTargetPool() {
+        for (unsigned int i = 0; i < m_Targets.size(); i++)
+            destroy((Target) i);
+    }
+
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    RenderTargetPool &operator=(const RenderTargetPool &) = delete;
+
+    // desc by value: it is often another target's, which create() moves when the list grows
+    Target acquire(RenderTargetDesc desc) {
+        for (unsigned int i = 0; i < m_Targets.size(); i++) {
+            Entry &entry = m_Targets[i];
+            if (entry.texture && !entry.inUse && entry.desc == desc) {
+                entry.inUse = true;
+                entry.lastUsedFrame = m_Frame;
+                return (Target) i;
+            }
+        }
+        Target target = create(desc);
+        m_Targets[target].inUse = true;
+        return target;
+    }
+
+    void release(Target target) {
+        if (target != None)
+            m_Targets[target].inUse = false;
+    }
+
+    unsigned int texture(Target target) const { return m_Targets[target].texture; }
+    const RenderTargetDesc &desc(Target target) const { return m_Targets[target].desc; }
+
+    // A framebuffer with color and, optionally, depth attached. Framebuffers are cached per
+    // combination, so binding the same targets every frame doesn't create new ones.
+    unsigned int framebuffer(Target color, Target depth = None) {
+        return framebuffer(color != None ? std::vector<Target>{color} : std::vector<Target>(), depth);
+    }
+
+    // The same with several color targets, attached and drawn to in the given order, so
+    // fragment output i lands in colors[i].
+    unsigned int framebuffer(const std::vector<Target> &colors, Target depth) {
+        for (const Framebuffer &fb : m_Framebuffers) {
+            if (fb.colors == colors && fb.depth == depth)
+                return fb.id;
+        }
+        Framebuffer fb;
+        fb.colors = colors;
+        fb.depth = depth;
+        glGenFramebuffers(1, &fb.id);
+        glBindFramebuffer(GL_FRAMEBUFFER, fb.id);
+        std::vector<GLenum> drawBuffers;
+        for (unsigned int i = 0; i < colors.size(); i++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, textureTarget(m_Targets[colors[i]].desc),
+                                   m_Targets[colors[i]].texture, 0);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+        }
+        if (drawBuffers.empty())
+            glDrawBuffer(GL_NONE);
+        else
+            glDrawBuffers((GLsizei) drawBuffers.size(), drawBuffers.data());
+        if (depth != None) {
+            GLenum attachment = m_Targets[depth].desc.format == GL_DEPTH24_STENCIL8 ||
+                                m_Targets[depth].desc.format == GL_DEPTH32F_STENCIL8
+                                ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(m_Targets[depth].desc),
+                                   m_Targets[depth].texture, 0);
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            ASSERT(false, "Pooled framebuffer not complete!");
+        }
+        m_Framebuffers.push_back(fb);
+        return fb.id;
+    }
+
+    // Deletes targets that have been idle too long. Call once per frame, after the last release.
+    void endFrame() {
+        for (unsigned int i = 0; i < m_Targets.size(); i++) {
+            Entry &entry = m_Targets[i];
+            if (entry.texture && !entry.inUse && m_Frame - entry.lastUsedFrame >= maxIdleFrames)
+                destroy((Target) i);
+        }
+        m_Frame++;
+        allocationsThisFrame = 0;
+    }
+
+    unsigned int size() const {
+        return (unsigned int) std::count_if(m_Targets.begin(), m_Targets.end(),
+                                            [](const Entry &entry) { return entry.texture != 0; });
+    }
+
+    long long bytesAllocated() const {
+        long long bytes = 0;
+        for (const Entry &entry : m_Targets) {
+            if (entry.texture)
+                bytes += (long long) entry.desc.width * entry.desc.height * entry.desc.samples * bytesPerPixel(entry.desc.format);
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        unsigned int texture = 0;
+        bool inUse = false;
+        unsigned int lastUsedFrame = 0;
+    };
+
+    struct Framebuffer {
+        std::vector<Target> colors;
+        Target depth = None;
+        unsigned int id = 0;
+    };
+
+    std::vector<Entry> m_Targets;
+    std::vector<Framebuffer> m_Framebuffers;
+    unsigned int m_Frame = 0;
+
+    static GLenum textureTarget(const RenderTargetDesc &desc) {
+        return desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    }
+
+    static int bytesPerPixel(GLenum format) {
+        switch (format) {
+            case GL_RGBA32F: return 16;
+            case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+            case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+            case GL_R8: return 1;
+            case GL_RG16F: case GL_R32F: case GL_R11F_G11F_B10F: case GL_RGBA8: case GL_RGB10_A2:
+            case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+        }
+        return 4;
+    }
+
+    // glTexImage2D wants a matching client format even when no data is uploaded
+    static void clientFormat(const RenderTargetDesc &desc, GLenum &format, GLenum &type) {
+        type = GL_FLOAT;
+        if (desc.format == GL_DEPTH24_STENCIL8 || desc.format == GL_DEPTH32F_STENCIL8) {
+            format = GL_DEPTH_STENCIL;
+            type = desc.format == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8 : GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+        } else if (desc.isDepth()) {
+            format = GL_DEPTH_COMPONENT;
+        } else if (desc.format == GL_R8 || desc.format == GL_R16F || desc.format == GL_R32F) {
+            format = GL_RED;
+        } else if (desc.format == GL_RG16F || desc.format == GL_RG32F) {
+            format = GL_RG;
+        } else if (desc.format == GL_R11F_G11F_B10F) {
+            format = GL_RGB;
+        } else {
+            format = GL_RGBA;
+            if (desc.format == GL_RGBA8)
+                type = GL_UNSIGNED_BYTE;
+        }
+    }
+
+    Target create(RenderTargetDesc desc) {
+        Target target = None;
+        for (unsigned int i = 0; i < m_Targets.size() && target == None; i++) {
+            if (!m_Targets[i].texture)
+                target = (Target) i;
+        }
+        if (target == None) {
+            target = (Target) m_Targets.size();
+            m_Targets.push_back(Entry());
+        }
+        Entry &entry = m_Targets[target];
+        entry.desc = desc;
+        entry.lastUsedFrame = m_Frame;
+        glGenTextures(1, &entry.texture);
+        if (desc.samples > 1) {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, entry.texture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+        } else {
+            GLenum format, type;
+            clientFormat(desc, format, type);
+            glBindTexture(GL_TEXTURE_2D, entry.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, format, type, nullptr);
+            GLint filter = desc.isDepth() ? GL_NEAREST : GL_LINEAR;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        allocationsThisFrame++;
+        return target;
+    }
+
+    void destroy(Target target) {
+        Entry &entry = m_Targets[target];
+        if (!entry.texture)
+            return;
+        for (unsigned int i = 0; i < m_Framebuffers.size();) {
+            const Framebuffer &fb = m_Framebuffers[i];
+            if (std::find(fb.colors.begin(), fb.colors.end(), target) != fb.colors.end() || fb.depth == target) {
+                glDeleteFramebuffers(1, &m_Framebuffers[i].id);
+                m_Framebuffers[i] = m_Framebuffers.back();
+                m_Framebuffers.pop_back();
+            } else {
+                i++;
+            }
+        }
+        glDeleteTextures(1, &entry.texture);
+        entry = Entry();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERTARGETPOOL_H
@@ -0,0 +1,187 @@
+//
+// All opaque scene meshes in one vertex and one index buffer, drawn from lists of commands.
+//
+
+#ifndef PROJECT_BASE_SCENEGEOMETRY_H
+#define PROJECT_BASE_SCENEGEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <rg/Error.h>
+#include <rg/GLExtensions.h>
+#include <rg/StreamBuffer.h>
+#include <cstddef>
+#include <vector>
+
+namespace rg {
+
+// Meshes are appended with add() and uploaded once; after that one VAO covers all of them and
+// a mesh is just a range of the index buffer plus a base vertex. Programs drawing from it read
+// an Instance per instance: the model matrix at InstanceAttribute (a mat4, four locations) and
+// the texture array layer of its material at MaterialAttribute. A draw is then fully described
+// by a DrawCommand: which range, how many instances, and where its instances start.
+//
+// draw() submits a list of commands with one glMultiDrawElementsIndirect where the driver has
+// it (4.3, or ARB_multi_draw_indirect with ARB_base_instance); the commands are written to the
+// stream buffer and read from there. On 3.3, where a draw can't start at another instance,
+// it loops over the commands and moves the instance attribute for each one instead.
+class SceneGeometry {
+public:
+    static const unsigned int InstanceAttribute = 5;
+    static const unsigned int MaterialAttribute = 9;
+
+    struct Instance {
+        glm::mat4 model;
+        GLuint layer;          // see rg::TextureArray
+        GLuint padding[3];     // the next model matrix starts 16-byte aligned
+    };
+
+    // the layout of DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Stats {
+        unsigned int drawCalls = 0;   // draw calls issued
+        unsigned int commands = 0;
+        unsigned int meshDraws = 0;   // draws it would take one mesh instance at a time
+    };
+
+    SceneGeometry() = default;
+
+    ~SceneGeometry() {
+        if (m_VAO) {
+            glDeleteVertexArrays(1, &m_VAO);
+            glDeleteBuffers(1, &m_VBO);
+            glDeleteBuffers(1, &m_EBO);
+        }
+    }
+
+    SceneGeometry(const SceneGeometry &) = delete;
+    SceneGeometry &operator=(const SceneGeometry &) = delete;
+
+    // Returns the id of the mesh, for command().
+    unsigned int add(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) {
+        ASSERT(!m_VAO, "Scene geometry already uploaded!");
+        m_Ranges.push_back({(GLuint) indices.size(), (GLuint) m_Indices.size(), (GLint) m_Vertices.size()});
+        m_Vertices.insert(m_Vertices.end(), vertices.begin(), vertices.end());
+        m_Indices.insert(m_Indices.end(), indices.begin(), indices.end());
+        return (unsigned int) m_Ranges.size() - 1;
+    }
+
+    // Adds the meshes of a model, their ids are consecutive starting at the one returned.
+    unsigned int add(const std::vector<Mesh> &meshes) {
+        unsigned int first = (unsigned int) m_Ranges.size();
+        for (const Mesh &mesh : meshes)
+            add(mesh.vertices, mesh.indices);
+        return first;
+    }
+
+    // Creates the buffers, the CPU copies are dropped.
+    void upload() {
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glGenBuffers(1, &m_EBO);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, m_Vertices.size() * sizeof(Vertex), m_Vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_Indices.size() * sizeof(unsigned int), m_Indices.data(), GL_STATIC_DRAW);
+        // the same locations as Mesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Bitangent));
+        for (unsigned int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(InstanceAttribute + column);
+            glVertexAttribDivisor(InstanceAttribute + column, 1);
+        }
+        glEnableVertexAttribArray(MaterialAttribute);
+        glVertexAttribDivisor(MaterialAttribute, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        std::vector<Vertex>().swap(m_Vertices);
+        std::vector<unsigned int>().swap(m_Indices);
+    }
+
+    unsigned int meshCount() const { return (unsigned int) m_Ranges.size(); }
+
+    // instanceCount instances of mesh, reading the Instances from firstInstance on
+    DrawCommand command(unsigned int mesh, unsigned int firstInstance, unsigned int instanceCount = 1) const {
+        const Range &range = m_Ranges[mesh];
+        return {range.count, instanceCount, range.firstIndex, range.baseVertex, firstInstance};
+    }
+
+    // Draws commands with the bound program; instance i reads the Instance at
+    // instances + i * sizeof(Instance) in stream. Commands are written to stream too.
+    void draw(StreamBuffer &stream, GLintptr instances, const std::vector<DrawCommand> &commands) {
+        if (commands.empty())
+            return;
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+        if (glExtensions().multiDrawIndirect) {
+            GLintptr offset = stream.write(commands.data(), commands.size() * sizeof(DrawCommand), 4);
+            setInstancePointer(instances);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer());
+            glExtensions().MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *) offset,
+                                                     (GLsizei) commands.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            m_Stats.drawCalls++;
+        }
+        else {
+            for (const DrawCommand &command : commands) {
+                setInstancePointer(instances + command.baseInstance * sizeof(Instance));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                                  (const void *) (command.firstIndex * sizeof(unsigned int)),
+                                                  command.instanceCount, command.baseVertex);
+            }
+            m_Stats.drawCalls += (unsigned int) commands.size();
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        m_Stats.commands += (unsigned int) commands.size();
+        for (const DrawCommand &command : commands)
+            m_Stats.meshDraws += command.instanceCount;
+    }
+
+    // counts of the draw() calls since the last resetStats()
+    const Stats &stats() const { return m_Stats; }
+    void resetStats() { m_Stats = Stats(); }
+
+private:
+    struct Range {
+        GLuint count;
+        GLuint firstIndex;
+        GLint baseVertex;
+    };
+
+    std::vector<Range> m_Ranges;
+    std::vector<Vertex> m_Vertices;
+    std::vector<unsigned int> m_Indices;
+    unsigned int m_VAO = 0, m_VBO = 0, m_EBO = 0;
+    Stats m_Stats;
+
+    // expects the stream buffer bound to GL_ARRAY_BUFFER
+    static void setInstancePointer(GLintptr offset) {
+        for (unsigned int column = 0; column < 4; column++)
+            glVertexAttribPointer(InstanceAttribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                  (const void *) (offset + column * sizeof(glm::vec4)));
+        glVertexAttribIPointer(MaterialAttribute, 1, GL_UNSIGNED_INT, sizeof(Instance),
+                               (const void *) (offset + offsetof(Instance, layer)));
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENEGEOMETRY_H
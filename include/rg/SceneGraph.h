@@ -0,0 +1,157 @@
+//
+// Parent/child transform hierarchy with cached world matrices.
+//
+
+#ifndef PROJECT_BASE_SCENEGRAPH_H
+#define PROJECT_BASE_SCENEGRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace rg {
+
+// Nodes live in flat arrays sorted by depth, so every parent sits before its children and
+// update() is a single front-to-back sweep. Only nodes whose local transform changed, or
+// whose parent's world matrix changed this update, get their world matrix recomputed.
+// Handles returned by createNode() stay valid when the arrays are re-sorted.
+class SceneGraph {
+public:
+    typedef int Node;
+    static const Node None = -1;
+
+    // world matrices recomputed by the last update(), for the stats overlay
+    unsigned int lastUpdated = 0;
+
+    Node createNode(Node parent = None) {
+        Node handle = (Node)m_IndexOf.size();
+        int parentIndex = parent == None ? -1 : m_IndexOf[parent];
+        m_IndexOf.push_back((int)m_Handle.size());
+        m_Handle.push_back(handle);
+        m_Parent.push_back(parentIndex);
+        m_Depth.push_back(parentIndex < 0 ? 0 : m_Depth[parentIndex] + 1);
+        m_Position.push_back(glm::vec3(0.0f));
+        m_Rotation.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        m_Scale.push_back(glm::vec3(1.0f));
+        m_World.push_back(glm::mat4(1.0f));
+        m_Dirty.push_back(1);
+        m_Changed.push_back(0);
+        if (m_Depth.size() > 1 && m_Depth.back() < m_Depth[m_Depth.size() - 2])
+            m_Sorted = false;
+        return handle;
+    }
+
+    void setPosition(Node node, const glm::vec3 &position) {
+        int i = m_IndexOf[node];
+        m_Position[i] = position;
+        m_Dirty[i] = 1;
+    }
+
+    void setRotation(Node node, const glm::quat &rotation) {
+        int i = m_IndexOf[node];
+        m_Rotation[i] = rotation;
+        m_Dirty[i] = 1;
+    }
+
+    void setRotation(Node node, float angle, const glm::vec3 &axis) {
+        setRotation(node, glm::angleAxis(angle, glm::normalize(axis)));
+    }
+
+    void setScale(Node node, const glm::vec3 &scale) {
+        int i = m_IndexOf[node];
+        m_Scale[i] = scale;
+        m_Dirty[i] = 1;
+    }
+
+    void setScale(Node node, float scale) {
+        setScale(node, glm::vec3(scale));
+    }
+
+    const glm::vec3 &position(Node node) const { return m_Position[m_IndexOf[node]]; }
+    const glm::mat4 &worldMatrix(Node node) const { return m_World[m_IndexOf[node]]; }
+    glm::vec3 worldPosition(Node node) const { return glm::vec3(m_World[m_IndexOf[node]][3]); }
+    unsigned int size() const { return (unsigned int)m_Handle.size(); }
+
+    void update() {
+        if (!m_Sorted)
+            sortByDepth();
+        lastUpdated = 0;
+        const unsigned int count = (unsigned int)m_Handle.size();
+        for (unsigned int i = 0; i < count; i++) {
+            int parent = m_Parent[i];
+            if (!m_Dirty[i] && (parent < 0 || !m_Changed[parent])) {
+                m_Changed[i] = 0;
+                continue;
+            }
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), m_Position[i]) * glm::mat4_cast(m_Rotation[i]);
+            local = glm::scale(local, m_Scale[i]);
+            m_World[i] = parent < 0 ? local : m_World[parent] * local;
+            m_Dirty[i] = 0;
+            m_Changed[i] = 1;
+            lastUpdated++;
+        }
+    }
+
+private:
+    std::vector<int> m_IndexOf;   // handle -> array index
+    std::vector<Node> m_Handle;   // array index -> handle
+    std::vector<int> m_Parent;    // array index of the parent, -1 for roots
+    std::vector<int> m_Depth;
+    std::vector<glm::vec3> m_Position;
+    std::vector<glm::quat> m_Rotation;
+    std::vector<glm::vec3> m_Scale;
+    std::vector<glm::mat4> m_World;
+    std::vector<unsigned char> m_Dirty;    // local transform changed since the last update
+    std::vector<unsigned char> m_Changed;  // world matrix was recomputed in the current update
+    bool m_Sorted = true;
+
+    template<typename T>
+    static void permute(std::vector<T> &values, const std::vector<int> &order) {
+        std::vector<T> sorted(values.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            sorted[i] = values[order[i]];
+        values.swap(sorted);
+    }
+
+    // Counting sort by depth; stable, so siblings keep their creation order.
+    void sortByDepth() {
+        const int count = (int)m_Handle.size();
+        int maxDepth = 0;
+        for (int d : m_Depth)
+            maxDepth = std::max(maxDepth, d);
+        std::vector<int> start(maxDepth + 2, 0);
+        for (int d : m_Depth)
+            start[d + 1]++;
+        for (int d = 1; d <= maxDepth + 1; d++)
+            start[d] += start[d - 1];
+        std::vector<int> order(count);
+        for (int i = 0; i < count; i++)
+            order[start[m_Depth[i]]++] = i;
+
+        std::vector<int> newIndex(count);
+        for (int i = 0; i < count; i++)
+            newIndex[order[i]] = i;
+        for (int &parent : m_Parent) {
+            if (parent >= 0)
+                parent = newIndex[parent];
+        }
+        permute(m_Handle, order);
+        permute(m_Parent, order);
+        permute(m_Depth, order);
+        permute(m_Position, order);
+        permute(m_Rotation, order);
+        permute(m_Scale, order);
+        permute(m_World, order);
+        permute(m_Dirty, order);
+        permute(m_Changed, order);
+        for (int i = 0; i < count; i++)
+            m_IndexOf[m_Handle[i]] = i;
+        m_Sorted = true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENEGRAPH_H
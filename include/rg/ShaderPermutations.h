@@ -0,0 +1,96 @@
+//
+// Specialized programs of one shader, compiled once per combination of feature #defines.
+//
+
+#ifndef PROJECT_BASE_SHADERPERMUTATIONS_H
+#define PROJECT_BASE_SHADERPERMUTATIONS_H
+
+#include <glad/glad.h>
+#include <learnopengl/shader.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Feature i of the list is bit i of the key: get(bits) returns the program built with
+// "#define <feature>" for every set bit, so a toggle that used to be a bool uniform tested
+// by every pixel becomes a choice between programs with the dead code compiled out.
+// Programs are cached by key. Compile the combinations that can come up with precompile()
+// at startup, so flipping a toggle never compiles in the middle of a frame; a key that
+// wasn't precompiled is still built on first use, and counted.
+class ShaderPermutations {
+public:
+    typedef unsigned int Features;
+
+    // runs on every newly compiled program, for uniforms that never change (sampler units)
+    std::function<void(Shader &)> setup;
+
+    ShaderPermutations(std::string vertexPath, std::string fragmentPath, std::vector<std::string> features,
+                       std::string prelude = std::string())
+            : m_VertexPath(std::move(vertexPath)), m_FragmentPath(std::move(fragmentPath)),
+              m_Features(std::move(features)), m_Prelude(std::move(prelude)) {}
+
+    ~ShaderPermutations() {
+        for (auto &entry : m_Programs)
+            glDeleteProgram(entry.second.ID);
+    }
+
+    ShaderPermutations(const ShaderPermutations &) = delete;
+    ShaderPermutations &operator=(const ShaderPermutations &) = delete;
+
+    void precompile(const std::vector<Features> &keys) {
+        for (Features key : keys) {
+            if (m_Programs.find(key) == m_Programs.end())
+                compile(key);
+        }
+    }
+
+    Shader &get(Features key) {
+        auto it = m_Programs.find(key);
+        if (it != m_Programs.end())
+            return it->second;
+        m_LateCompiles++;
+        return compile(key);
+    }
+
+    unsigned int size() const { return (unsigned int) m_Programs.size(); }
+    // programs built by get() because they were not precompiled
+    unsigned int lateCompiles() const { return m_LateCompiles; }
+
+    // the feature names of key, one after another with separator in between
+    std::string defines(Features key, const std::string &separator) const {
+        std::string result;
+        for (unsigned int i = 0; i < m_Features.size(); i++) {
+            if (key & (1u << i))
+                result += (result.empty() ? "" : separator) + m_Features[i];
+        }
+        return result;
+    }
+
+private:
+    std::string m_VertexPath;
+    std::string m_FragmentPath;
+    std::vector<std::string> m_Features;
+    std::string m_Prelude;
+    std::map<Features, Shader> m_Programs;
+    unsigned int m_LateCompiles = 0;
+
+    Shader &compile(Features key) {
+        std::string prelude = m_Prelude;
+        for (unsigned int i = 0; i < m_Features.size(); i++) {
+            if (key & (1u << i))
+                prelude += (prelude.empty() ? "" : "\n") + ("#define " + m_Features[i]);
+        }
+        Shader &shader = m_Programs.emplace(key, Shader(m_VertexPath.c_str(), m_FragmentPath.c_str(), prelude)).first->second;
+        if (setup)
+            setup(shader);
+        return shader;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERPERMUTATIONS_H
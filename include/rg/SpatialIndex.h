@@ -0,0 +1,413 @@
+//
+// Bounding volumes and a refittable BVH used to cull the asteroid belt.
+//
+
+#ifndef PROJECT_BASE_SPATIALINDEX_H
+#define PROJECT_BASE_SPATIALINDEX_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/Benchmark.h>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+namespace rg {
+
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    AABB() = default;
+    AABB(const glm::vec3 &minCorner, const glm::vec3 &maxCorner) : min(minCorner), max(maxCorner) {}
+
+    static AABB fromSphere(const glm::vec3 &center, float radius) {
+        return AABB(center - glm::vec3(radius), center + glm::vec3(radius));
+    }
+
+    void expand(const AABB &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    float surfaceArea() const {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+struct Sphere {
+    glm::vec3 center;
+    float radius;
+};
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+enum class Containment {
+    Outside,
+    Intersects,
+    Inside
+};
+
+// Six planes pointing inwards, extracted from a projection * view matrix (Gribb & Hartmann).
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4 &m) {
+        Frustum f;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        f.planes[0] = row3 + row0;
+        f.planes[1] = row3 - row0;
+        f.planes[2] = row3 + row1;
+        f.planes[3] = row3 - row1;
+        f.planes[4] = row3 + row2;
+        f.planes[5] = row3 - row2;
+        for (glm::vec4 &p : f.planes) {
+            p /= glm::length(glm::vec3(p));
+        }
+        return f;
+    }
+
+    Containment classify(const AABB &box) const {
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extent();
+        Containment result = Containment::Inside;
+        for (const glm::vec4 &p : planes) {
+            glm::vec3 n(p);
+            float d = glm::dot(n, c) + p.w;
+            float r = glm::dot(glm::abs(n), e);
+            if (d < -r)
+                return Containment::Outside;
+            if (d < r)
+                result = Containment::Intersects;
+        }
+        return result;
+    }
+
+    bool intersects(const AABB &box) const {
+        return classify(box) != Containment::Outside;
+    }
+};
+
+inline bool intersects(const Sphere &sphere, const AABB &box) {
+    glm::vec3 closest = glm::clamp(sphere.center, box.min, box.max);
+    glm::vec3 d = closest - sphere.center;
+    return glm::dot(d, d) <= sphere.radius * sphere.radius;
+}
+
+// Slab test; on a hit writes the entry distance (0 when the origin is inside the box).
+inline bool intersects(const Ray &ray, const glm::vec3 &invDirection, const AABB &box, float maxDistance, float &tNear) {
+    glm::vec3 t0 = (box.min - ray.origin) * invDirection;
+    glm::vec3 t1 = (box.max - ray.origin) * invDirection;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    float enter = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+    float exit = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, maxDistance));
+    tNear = enter;
+    return enter <= exit;
+}
+
+// Bounding volume hierarchy over a fixed set of primitives (one AABB each).
+// Topology is built once with a median split; every frame the boxes are refitted
+// bottom-up in a single reverse sweep, and the tree is rebuilt only when the moving
+// primitives have degraded it past rebuildThreshold (measured with the SAH cost).
+class BVH {
+public:
+    static const int LeafSize = 8;
+
+    float rebuildThreshold = 1.6f;
+
+    void build(const std::vector<AABB> &bounds) {
+        m_Nodes.clear();
+        m_Primitives.resize(bounds.size());
+        m_Centroids.resize(bounds.size());
+        for (unsigned int i = 0; i < bounds.size(); i++) {
+            m_Primitives[i] = (int)i;
+            m_Centroids[i] = bounds[i].center();
+        }
+        if (bounds.empty()) {
+            m_BuiltCost = m_Cost = 0.0f;
+            return;
+        }
+        m_Nodes.reserve(2 * bounds.size() / LeafSize + 1);
+        m_Nodes.push_back(Node());
+        subdivide(0, 0, (int)bounds.size(), bounds);
+        m_BuiltCost = m_Cost = sahCost();
+    }
+
+    // Updates node bounds for primitives that moved; rebuilds when the tree got too loose.
+    // Returns true when a full rebuild happened.
+    bool refit(const std::vector<AABB> &bounds) {
+        if (m_Primitives.size() != bounds.size()) {
+            build(bounds);
+            return true;
+        }
+        float cost = 0.0f;
+        for (int i = (int)m_Nodes.size() - 1; i >= 0; i--) {
+            Node &node = m_Nodes[i];
+            if (node.count > 0) {
+                node.bounds = bounds[m_Primitives[node.first]];
+                for (int j = node.first + 1; j < node.first + node.count; j++)
+                    node.bounds.expand(bounds[m_Primitives[j]]);
+                cost += node.bounds.surfaceArea() * (float)node.count;
+            } else {
+                node.bounds = m_Nodes[node.first].bounds;
+                node.bounds.expand(m_Nodes[node.first + 1].bounds);
+                cost += node.bounds.surfaceArea();
+            }
+        }
+        float rootArea = m_Nodes[0].bounds.surfaceArea();
+        m_Cost = rootArea > 0.0f ? cost / rootArea : 0.0f;
+        if (m_Cost > m_BuiltCost * rebuildThreshold) {
+            build(bounds);
+            return true;
+        }
+        return false;
+    }
+
+    // Calls visit(primitive) for every primitive whose box is not outside the frustum.
+    template<typename Visitor>
+    void queryFrustum(const Frustum &frustum, const std::vector<AABB> &bounds, Visitor &&visit) const {
+        if (m_Nodes.empty())
+            return;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = m_Nodes[stack[--top]];
+            Containment c = frustum.classify(node.bounds);
+            if (c == Containment::Outside)
+                continue;
+            if (c == Containment::Inside) {
+                visitSubtree(node, visit);
+                continue;
+            }
+            if (node.count > 0) {
+                for (int j = node.first; j < node.first + node.count; j++) {
+                    if (frustum.intersects(bounds[m_Primitives[j]]))
+                        visit(m_Primitives[j]);
+                }
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void querySphere(const Sphere &sphere, const std::vector<AABB> &bounds, Visitor &&visit) const {
+        if (m_Nodes.empty())
+            return;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = m_Nodes[stack[--top]];
+            if (!intersects(sphere, node.bounds))
+                continue;
+            if (node.count > 0) {
+                for (int j = node.first; j < node.first + node.count; j++) {
+                    if (intersects(sphere, bounds[m_Primitives[j]]))
+                        visit(m_Primitives[j]);
+                }
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    // Closest primitive box hit by the ray, or -1. Children are visited near-first so
+    // far subtrees get rejected by the shrinking maxDistance.
+    int raycast(const Ray &ray, const std::vector<AABB> &bounds, float maxDistance, float *hitDistance = nullptr) const {
+        if (m_Nodes.empty())
+            return -1;
+        glm::vec3 invDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+        int closest = -1;
+        float t;
+        int stack[64];
+        int top = 0;
+        if (intersects(ray, invDirection, m_Nodes[0].bounds, maxDistance, t))
+            stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = m_Nodes[stack[--top]];
+            if (!intersects(ray, invDirection, node.bounds, maxDistance, t))
+                continue;
+            if (node.count > 0) {
+                for (int j = node.first; j < node.first + node.count; j++) {
+                    if (intersects(ray, invDirection, bounds[m_Primitives[j]], maxDistance, t)) {
+                        maxDistance = t;
+                        closest = m_Primitives[j];
+                    }
+                }
+                continue;
+            }
+            float tLeft, tRight;
+            bool hitLeft = intersects(ray, invDirection, m_Nodes[node.first].bounds, maxDistance, tLeft);
+            bool hitRight = intersects(ray, invDirection, m_Nodes[node.first + 1].bounds, maxDistance, tRight);
+            if (hitLeft && hitRight) {
+                // push the far child first so the near one is popped next
+                bool leftFirst = tLeft <= tRight;
+                stack[top++] = leftFirst ? node.first + 1 : node.first;
+                stack[top++] = leftFirst ? node.first : node.first + 1;
+            } else if (hitLeft) {
+                stack[top++] = node.first;
+            } else if (hitRight) {
+                stack[top++] = node.first + 1;
+            }
+        }
+        if (hitDistance)
+            *hitDistance = maxDistance;
+        return closest;
+    }
+
+    unsigned int nodeCount() const { return (unsigned int)m_Nodes.size(); }
+    float quality() const { return m_BuiltCost > 0.0f ? m_Cost / m_BuiltCost : 1.0f; }
+
+private:
+    struct Node {
+        AABB bounds;
+        int first = 0;  // first primitive for leaves, left child for inner nodes (right is first + 1)
+        int count = 0;  // 0 for inner nodes
+    };
+
+    std::vector<Node> m_Nodes;
+    std::vector<int> m_Primitives;
+    std::vector<glm::vec3> m_Centroids;
+    float m_BuiltCost = 0.0f;
+    float m_Cost = 0.0f;
+
+    void subdivide(int nodeIndex, int begin, int end, const std::vector<AABB> &bounds) {
+        AABB box, centroidBox;
+        for (int i = begin; i < end; i++) {
+            box.expand(bounds[m_Primitives[i]]);
+            centroidBox.expand(AABB(m_Centroids[m_Primitives[i]], m_Centroids[m_Primitives[i]]));
+        }
+        m_Nodes[nodeIndex].bounds = box;
+        if (end - begin <= LeafSize) {
+            m_Nodes[nodeIndex].first = begin;
+            m_Nodes[nodeIndex].count = end - begin;
+            return;
+        }
+
+        glm::vec3 size = centroidBox.max - centroidBox.min;
+        int axis = 0;
+        if (size.y > size[axis]) axis = 1;
+        if (size.z > size[axis]) axis = 2;
+        int mid = (begin + end) / 2;
+        std::nth_element(m_Primitives.begin() + begin, m_Primitives.begin() + mid, m_Primitives.begin() + end,
+                         [this, axis](int a, int b) { return m_Centroids[a][axis] < m_Centroids[b][axis]; });
+
+        int left = (int)m_Nodes.size();
+        m_Nodes.push_back(Node());
+        m_Nodes.push_back(Node());
+        m_Nodes[nodeIndex].first = left;
+        m_Nodes[nodeIndex].count = 0;
+        subdivide(left, begin, mid, bounds);
+        subdivide(left + 1, mid, end, bounds);
+    }
+
+    template<typename Visitor>
+    void visitSubtree(const Node &root, Visitor &visit) const {
+        int stack[64];
+        int top = 0;
+        const Node *node = &root;
+        for (;;) {
+            if (node->count > 0) {
+                for (int j = node->first; j < node->first + node->count; j++)
+                    visit(m_Primitives[j]);
+            } else {
+                stack[top++] = node->first + 1;
+                stack[top++] = node->first;
+            }
+            if (top == 0)
+                break;
+            node = &m_Nodes[stack[--top]];
+        }
+    }
+
+    // Surface area heuristic cost of the tree relative to its root.
+    float sahCost() const {
+        float rootArea = m_Nodes[0].bounds.surfaceArea();
+        if (rootArea <= 0.0f)
+            return 0.0f;
+        float cost = 0.0f;
+        for (const Node &node : m_Nodes)
+            cost += node.bounds.surfaceArea() * (node.count > 0 ? (float)node.count : 1.0f);
+        return cost / rootArea;
+    }
+};
+
+// Refit + frustum query against testing every rock, for belts orbiting the way main() moves them.
+inline void benchmarkSpatialIndex() {
+    const int frames = 30;
+    const glm::vec3 saturn(100.0f, 0.0f, 0.0f);
+    const float rockRadius = 0.7f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    // flying along the belt, so only part of it is in view
+    glm::vec3 eye = saturn + glm::vec3(0.0f, 2.0f, -20.0f);
+    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    std::cout << "Asteroid culling, " << frames << " frames, times are per frame in ms\n";
+    BenchmarkTable table({"rocks", "brute", "refit", "query", "bvh total", "visible", "rebuilds"});
+    for (int count : {1000, 10000, 100000, 500000}) {
+        srand(42);
+        std::vector<float> radius(count), height(count);
+        for (int i = 0; i < count; i++) {
+            radius[i] = 20.0f + (float)(rand() % 7 - 3);
+            height[i] = (float)(rand() % 3 - 1);
+        }
+        std::vector<AABB> bounds(count);
+        auto moveRocks = [&](float time) {
+            for (int i = 0; i < count; i++) {
+                float a = time * 0.1f * (glm::radians(360.0f) / (float)count) * (float)i;
+                glm::vec3 p = saturn + glm::vec3(radius[i] * cos(a), height[i], radius[i] * sin(a));
+                bounds[i] = AABB::fromSphere(p, rockRadius);
+            }
+        };
+
+        // by t = 10s the i-dependent angular speeds have spread the rocks around the whole ring
+        const float startTime = 10.0f;
+        moveRocks(startTime);
+        BVH bvh;
+        bvh.build(bounds);
+        double brute = 0.0, refit = 0.0, query = 0.0;
+        int visible = 0, rebuilds = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            moveRocks(startTime + (float)frame / 60.0f);
+
+            Stopwatch sw;
+            int bruteVisible = 0;
+            for (const AABB &box : bounds)
+                bruteVisible += frustum.intersects(box) ? 1 : 0;
+            brute += sw.elapsedMilliseconds();
+
+            sw.reset();
+            rebuilds += bvh.refit(bounds) ? 1 : 0;
+            refit += sw.elapsedMilliseconds();
+
+            sw.reset();
+            visible = 0;
+            bvh.queryFrustum(frustum, bounds, [&visible](int) { visible++; });
+            query += sw.elapsedMilliseconds();
+            if (visible != bruteVisible)
+                std::cerr << "BVH returned " << visible << " rocks, brute force " << bruteVisible << '\n';
+        }
+        table.row(count, brute / frames, refit / frames, query / frames, (refit + query) / frames, visible, rebuilds);
+    }
+}
+
+}
+
+#endif //PROJECT_BASE_SPATIALINDEX_H
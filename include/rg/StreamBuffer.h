@@ -0,0 +1,196 @@
+//
+// Ring buffer for data written by the CPU every frame: instance attributes, uniform blocks.
+//
+
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include <rg/Error.h>
+#include <rg/GLExtensions.h>
+#include <cstring>
+
+namespace rg {
+
+// One buffer object split into FrameCount regions, one per frame in flight. A frame
+// sub-allocates from its region with allocate(), writes through the returned pointer and
+// calls commit() before anything draws from it; endFrame() fences the region, and
+// beginFrame() only hands a region out again once the GPU has passed that fence, so the
+// CPU never writes over data a queued frame still reads.
+//
+// With ARB_buffer_storage the whole buffer is mapped once, persistently and coherently, and
+// allocate() is pointer arithmetic. On plain 3.3 every allocation maps its own range
+// unsynchronized (the fences already keep it safe) and commit() unmaps it; a region the GPU
+// hasn't finished with is not waited for there, the buffer is orphaned instead and the driver
+// hands out fresh storage.
+class StreamBuffer {
+public:
+    static const int FrameCount = 3;
+
+    struct Allocation {
+        void *data;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    // frameSize bytes for every frame, FrameCount times over
+    explicit StreamBuffer(GLsizeiptr frameSize)
+            : m_FrameSize(frameSize), m_Persistent(glExtensions().bufferStorage) {
+        GLint uniformAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        m_UniformAlignment = uniformAlignment;
+        // every region starts on a boundary any allocation could ask for
+        m_FrameSize = align(m_FrameSize, m_UniformAlignment);
+
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+        if (m_Persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExtensions().BufferStorage(GL_COPY_WRITE_BUFFER, m_FrameSize * FrameCount, nullptr, flags);
+            m_Mapped = (char *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_FrameSize * FrameCount, flags);
+            ASSERT(m_Mapped, "Persistent mapping of the stream buffer failed!");
+        }
+        else {
+            glBufferData(GL_COPY_WRITE_BUFFER, m_FrameSize * FrameCount, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    ~StreamBuffer() {
+        for (GLsync fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (m_Persistent) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_Buffer);
+    }
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    unsigned int buffer() const { return m_Buffer; }
+    bool persistent() const { return m_Persistent; }
+    GLsizeiptr frameSize() const { return m_FrameSize; }
+    // alignment for ranges bound with glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    GLsizeiptr uniformAlignment() const { return m_UniformAlignment; }
+
+    // bytes allocated in the current frame
+    GLsizeiptr used() const { return m_Head; }
+    // times beginFrame() had to wait for the GPU, or orphaned the buffer instead
+    unsigned int stalls() const { return m_Stalls; }
+
+    void beginFrame() {
+        m_Region = (m_Region + 1) % FrameCount;
+        m_Head = 0;
+        GLsync &fence = m_Fences[m_Region];
+        if (!fence)
+            return;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            m_Stalls++;
+            if (m_Persistent) {
+                // the storage is immutable, the only way forward is to wait
+                while (status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            else {
+                orphan();
+                return;
+            }
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // Marks the end of the frame's use of its region, call after the last draw reading it.
+    void endFrame() {
+        ASSERT(!m_Open, "Stream buffer allocation not committed at the end of the frame!");
+        if (m_Fences[m_Region])
+            glDeleteSync(m_Fences[m_Region]);
+        m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // size bytes starting at a multiple of alignment, valid until commit().
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16) {
+        ASSERT(!m_Open, "Stream buffer allocation still open!");
+        GLsizeiptr start = align(m_Head, alignment);
+        ASSERT(start + size <= m_FrameSize, "Stream buffer region too small for this frame!");
+        m_Head = start + size;
+        GLintptr offset = m_Region * m_FrameSize + start;
+        Allocation allocation = {nullptr, offset, size};
+        if (m_Persistent) {
+            allocation.data = m_Mapped + offset;
+        }
+        else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                               GL_MAP_UNSYNCHRONIZED_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            ASSERT(allocation.data, "Mapping a stream buffer range failed!");
+            m_Open = true;
+        }
+        return allocation;
+    }
+
+    // Makes the writes of the last allocation visible to the GPU.
+    void commit() {
+        if (!m_Open)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_Open = false;
+    }
+
+    // Allocates and fills in one go, returns the offset.
+    GLintptr write(const void *data, GLsizeiptr size, GLsizeiptr alignment = 16) {
+        Allocation allocation = allocate(size, alignment);
+        std::memcpy(allocation.data, data, (size_t) size);
+        commit();
+        return allocation.offset;
+    }
+
+    // Writes value as a uniform block and binds it to the binding point.
+    template<typename T>
+    void bindUniform(unsigned int binding, const T &value) {
+        GLintptr offset = write(&value, sizeof(T), m_UniformAlignment);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_Buffer, offset, sizeof(T));
+    }
+
+private:
+    GLsizeiptr m_FrameSize;
+    GLsizeiptr m_UniformAlignment;
+    bool m_Persistent;
+    unsigned int m_Buffer = 0;
+    char *m_Mapped = nullptr;
+    GLsync m_Fences[FrameCount] = {};
+    int m_Region = 0;
+    GLsizeiptr m_Head = 0;
+    bool m_Open = false;
+    unsigned int m_Stalls = 0;
+
+    static GLsizeiptr align(GLsizeiptr value, GLsizeiptr alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // New storage for the whole buffer; the frames still queued keep the old one.
+    void orphan() {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_FrameSize * FrameCount, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        for (GLsync &fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
@@ -0,0 +1,105 @@
+//
+// Material textures packed into the layers of one GL_TEXTURE_2D_ARRAY, so draws with different materials need no binds.
+//
+
+#ifndef PROJECT_BASE_TEXTUREARRAY_H
+#define PROJECT_BASE_TEXTUREARRAY_H
+
+#include <glad/glad.h>
+#include <rg/Error.h>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace rg {
+
+// Textures are collected with add(), which hands out the layer each one will land in, and
+// copied over in upload(). Every layer has the same size; a texture of another size is scaled
+// into its layer by a linear framebuffer blit on the GPU, so the images are not decoded again.
+// Texture coordinates stay as they are, a texture that was tiled across the mesh still tiles.
+// Layer 0 is plain white, for meshes without a texture.
+class TextureArray {
+public:
+    static const unsigned int WhiteLayer = 0;
+
+    TextureArray(int width, int height)
+            : m_Width(width), m_Height(height) {}
+
+    ~TextureArray() {
+        if (m_Texture)
+            glDeleteTextures(1, &m_Texture);
+    }
+
+    TextureArray(const TextureArray &) = delete;
+    TextureArray &operator=(const TextureArray &) = delete;
+
+    // Returns the layer of a 2D texture, the same one every time it is added.
+    unsigned int add(unsigned int texture) {
+        ASSERT(!m_Texture, "Texture array already uploaded!");
+        auto inserted = m_Layers.insert({texture, (unsigned int) m_Sources.size() + 1});
+        if (inserted.second)
+            m_Sources.push_back(texture);
+        return inserted.first->second;
+    }
+
+    // Creates the array and copies the textures in, with mipmaps.
+    void upload() {
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        ASSERT((GLint) layerCount() <= maxLayers, "More materials than texture array layers!");
+
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, m_Width, m_Height, (GLsizei) layerCount(), 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        unsigned int framebuffers[2];
+        glGenFramebuffers(2, framebuffers);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_Texture, 0, WhiteLayer);
+        const GLfloat white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glClearBufferfv(GL_COLOR, 0, white);
+        for (unsigned int i = 0; i < m_Sources.size(); i++) {
+            GLint width = 0, height = 0;
+            glBindTexture(GL_TEXTURE_2D, m_Sources[i]);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Sources[i], 0);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_Texture, 0, (GLint) i + 1);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, m_Width, m_Height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(2, framebuffers);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    unsigned int texture() const { return m_Texture; }
+    unsigned int layerCount() const { return (unsigned int) m_Sources.size() + 1; }
+    // bytes of the array with its mipmaps
+    size_t memorySize() const { return (size_t) m_Width * m_Height * 4 * layerCount() * 4 / 3; }
+
+private:
+    int m_Width, m_Height;
+    unsigned int m_Texture = 0;
+    std::map<unsigned int, unsigned int> m_Layers;
+    std::vector<unsigned int> m_Sources;
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTUREARRAY_H
@@ -0,0 +1,241 @@
+//
+// Captures a window of frames as a Chrome trace-event JSON file, for chrome://tracing or Perfetto.
+//
+
+#ifndef PROJECT_BASE_TRACERECORDER_H
+#define PROJECT_BASE_TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rg {
+
+// capture(path, frames) arms the recorder: from the next beginFrame() on it keeps the begin
+// and end of every CPU scope, from whichever thread, a marker at every frame boundary, and
+// the GPU scopes of the same frames. GPU times are on the GPU's own clock and arrive a few
+// frames late; calibrate() pairs a GL_TIMESTAMP reading with the CPU time at the start of
+// the capture, and gpuScope() moves them onto the CPU timeline with that offset. Once the
+// last frame of the window had time to come back from the GPU the file is written, and the
+// recorder goes idle again.
+//
+// Recording takes a lock per event, which is fine for a capture of a few hundred frames;
+// while idle, scopes cost one atomic load.
+class TraceRecorder {
+public:
+    // frames beginFrame() keeps waiting after the window for its GPU times
+    static const unsigned int GpuLatency = 3;
+
+    class Scope {
+    public:
+        Scope(TraceRecorder *trace, const std::string &name)
+                : m_Trace(trace && trace->recording() ? trace : nullptr) {
+            if (m_Trace)
+                m_Trace->begin(name);
+        }
+
+        ~Scope() {
+            if (m_Trace)
+                m_Trace->end();
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        TraceRecorder *m_Trace;
+    };
+
+    TraceRecorder()
+            : m_Epoch(std::chrono::steady_clock::now()) {
+        threadIndex();   // the constructing thread is "main"
+    }
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    // Starts a capture of the next frameCount frames, unless one is already running.
+    bool capture(const std::string &path, unsigned int frameCount) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_State != Idle || frameCount == 0)
+            return false;
+        m_Path = path;
+        m_FramesLeft = frameCount;
+        m_State = Armed;
+        return true;
+    }
+
+    bool recording() const { return m_Recording.load(std::memory_order_relaxed); }
+    // the capture needs calibrate() called before the GPU times of its frames come in
+    bool needsCalibration() const {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_State == Armed;
+    }
+
+    // Frame boundary, called from the render thread before anything of the frame is recorded.
+    void beginFrame(unsigned int frame) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        switch (m_State) {
+            case Idle:
+                return;
+            case Armed:
+                m_FirstFrame = frame;
+                m_State = Recording;
+                m_Recording = true;
+                break;
+            case Recording:
+                if (m_FramesLeft == 0) {
+                    m_State = Draining;
+                    m_Recording = false;
+                    m_FramesLeft = GpuLatency;
+                    return;
+                }
+                break;
+            case Draining:
+                if (--m_FramesLeft == 0) {
+                    write();
+                    m_State = Idle;
+                }
+                return;
+        }
+        m_FramesLeft--;
+        m_LastFrame = frame;
+        m_Events.push_back({"frame " + std::to_string(frame), 'i', 0, now(), 0.0});
+    }
+
+    // Writes a capture the run ended in the middle of, with whatever it has.
+    void finish() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_State == Recording || m_State == Draining)
+            write();
+        m_State = Idle;
+        m_Recording = false;
+    }
+
+    // Pairs a GL_TIMESTAMP reading in nanoseconds with the CPU time it was taken at.
+    void calibrate(int64_t gpuNanoseconds) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_GpuOffset = now() - (double) gpuNanoseconds / 1000.0;
+    }
+
+    void begin(const std::string &name) {
+        double time = now();
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Events.push_back({name, 'B', threadIndex(), time, 0.0});
+    }
+
+    void end() {
+        double time = now();
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Events.push_back({std::string(), 'E', threadIndex(), time, 0.0});
+    }
+
+    // A GPU scope of the given frame from its two GL_TIMESTAMP results, dropped unless the
+    // frame is in the captured window.
+    void gpuScope(const std::string &name, unsigned int frame, uint64_t beginNanoseconds, uint64_t endNanoseconds) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if ((m_State != Recording && m_State != Draining) || frame < m_FirstFrame ||
+            (m_State == Draining && frame > m_LastFrame))
+            return;
+        m_Events.push_back({name, 'X', GpuThread, (double) beginNanoseconds / 1000.0 + m_GpuOffset,
+                            (double) (endNanoseconds - beginNanoseconds) / 1000.0});
+    }
+
+private:
+    enum State {
+        Idle,
+        Armed,       // capture() was called, the window starts at the next frame
+        Recording,
+        Draining     // the window is over, only GPU times of its frames still come in
+    };
+
+    struct Event {
+        std::string name;
+        char phase;        // B and E for CPU scopes, X for GPU scopes, i for frame markers
+        int thread;
+        double time;       // microseconds since the recorder was made
+        double duration;   // X only
+    };
+
+    // the GPU timeline is shown as one more thread
+    static const int GpuThread = -1;
+
+    std::chrono::steady_clock::time_point m_Epoch;
+    mutable std::mutex m_Mutex;
+    std::atomic<bool> m_Recording{false};
+    State m_State = Idle;
+    std::string m_Path;
+    unsigned int m_FramesLeft = 0;
+    unsigned int m_FirstFrame = 0;
+    unsigned int m_LastFrame = 0;
+    double m_GpuOffset = 0.0;
+    std::vector<Event> m_Events;
+    std::map<std::thread::id, int> m_Threads;
+
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_Epoch).count();
+    }
+
+    // small stable number of the calling thread, in order of first appearance
+    int threadIndex() {
+        auto inserted = m_Threads.insert({std::this_thread::get_id(), (int) m_Threads.size()});
+        return inserted.first->second;
+    }
+
+    static std::string escape(const std::string &text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    void write() {
+        std::ofstream out(m_Path);
+        if (!out) {
+            std::cout << "Failed to write trace " << m_Path << std::endl;
+            m_Events.clear();
+            return;
+        }
+        const int pid = 1;
+        auto tid = [](int thread) { return thread == GpuThread ? 1000 : thread; };
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"ph\":\"M\",\"pid\":" << pid << ",\"name\":\"process_name\",\"args\":{\"name\":\"project_base\"}}";
+        for (unsigned int t = 0; t < m_Threads.size(); t++) {
+            out << ",\n{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << t << ",\"name\":\"thread_name\",\"args\":{\"name\":\""
+                << (t == 0 ? std::string("main") : "worker " + std::to_string(t)) << "\"}}";
+        }
+        out << ",\n{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid(GpuThread)
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":\"GPU\"}}";
+        out << std::fixed << std::setprecision(3);
+        for (const Event &event : m_Events) {
+            out << ",\n{\"ph\":\"" << event.phase << "\",\"pid\":" << pid << ",\"tid\":" << tid(event.thread)
+                << ",\"ts\":" << event.time;
+            if (event.phase == 'X')
+                out << ",\"dur\":" << event.duration;
+            if (event.phase == 'i')
+                out << ",\"s\":\"g\"";
+            if (event.phase != 'E')
+                out << ",\"name\":\"" << escape(event.name) << "\"";
+            out << "}";
+        }
+        out << "\n]}\n";
+        std::cout << "Trace of frames " << m_FirstFrame << "-" << m_LastFrame << " (" << m_Events.size()
+                  << " events) written to " << m_Path << std::endl;
+        m_Events.clear();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TRACERECORDER_H
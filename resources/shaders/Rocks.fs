@@ -1,104 +1,45 @@
 #version 330 core
 
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+#include "frame.glsl"
+#include "lighting.glsl"
+#include "clusters.glsl"
+#include "gbuffer.glsl"
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
     vec3 Normal;
+    flat uint Layer;
 } fs_in;
 
+#ifdef DEFERRED
+layout (location = 0) out vec4 GAlbedo;
+layout (location = 1) out vec2 GNormal;
+#else
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
+#endif
 
-uniform bool FlashLight;
 uniform PointLight pointLight;
 uniform SpotLight spotLight;
-uniform sampler2D texture_diffuse1;
-uniform vec3 viewPos;
+uniform sampler2DArray materials;
 
+// FLASHLIGHT is defined for the program used while the flashlight is on, DEFERRED for the one
+// writing the G-buffer, lit afterwards by deferredLighting.fs
 void main()
 {
     vec3 norm = normalize(fs_in.Normal);
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
-    vec3 result = CalcPointLight(pointLight,norm,fs_in.FragPos,viewDir);
-    result+=CalcSpotLight(spotLight,norm,fs_in.FragPos,viewDir);
-
-    float brightness=dot(result,vec3(0.2126,0.7152,0.0722));
-        if (brightness > 1.0){
-            BrightColor=vec4(result,1.0);
-        }else{
-            BrightColor = vec4(0.0,0.0,0.0,1.0);
-        }
-
+    vec3 albedo = texture(materials, vec3(fs_in.TexCoords, fs_in.Layer)).rgb;
+#ifdef DEFERRED
+    GAlbedo = vec4(albedo, MaterialLit);
+    GNormal = EncodeNormal(norm);
+#else
+    vec3 viewDir = normalize(viewPosition - fs_in.FragPos);
+    vec3 result = CalcPointLight(pointLight,albedo,norm,fs_in.FragPos,viewDir);
+    result+=CalcClusteredLights(albedo,norm,fs_in.FragPos,viewDir);
+#ifdef FLASHLIGHT
+    result+=CalcSpotLight(spotLight,albedo,norm,fs_in.FragPos,viewDir);
+#endif
 
     FragColor = vec4(result, 1.0);
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir+viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0f);
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir+viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0f);
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    return (ambient + diffuse + specular);
+#endif
 }
\ No newline at end of file
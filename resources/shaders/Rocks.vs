@@ -1,22 +1,26 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoords;
-layout (location = 2) in vec3 aNormal;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// one matrix per rock, the rocks are drawn instanced, see rg::SceneGeometry
+layout (location = 5) in mat4 instanceModel;
+// its layer of the material texture array
+layout (location = 9) in uint instanceLayer;
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
     vec3 Normal;
+    flat uint Layer;
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame.glsl"
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+    vs_out.FragPos = vec3(instanceModel * vec4(aPos, 1.0));
     vs_out.TexCoords = aTexCoords;
-    vs_out.Normal = mat3(inverse(transpose(model))) * aNormal;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vs_out.Layer = instanceLayer;
+    vs_out.Normal = mat3(inverse(transpose(instanceModel))) * aNormal;
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -1,24 +1,19 @@
 #version 330 core
+
+#include "gbuffer.glsl"
+
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
 
-struct Material {
-    sampler2D texture_diffuse1;
-};
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+flat in uint Layer;
 
-uniform Material material;
+uniform sampler2DArray materials;
 
 
 void main()
 {
-    FragColor = texture(material.texture_diffuse1,TexCoords);
-    float brightness=dot(FragColor.rgb,vec3(0.2126,0.7152,0.0722));
-    if (brightness > 1.0){
-        BrightColor=vec4(FragColor.rgb,1.0);
-    }else{
-        BrightColor = vec4(0.0,0.0,0.0,1.0);
-    }
+    // opaque, and marked unlit where the deferred path reads it from the G-buffer
+    FragColor = vec4(texture(materials,vec3(TexCoords,Layer)).rgb,MaterialEmissive);
 }
\ No newline at end of file
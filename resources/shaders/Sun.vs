@@ -2,19 +2,23 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// model matrix of the instance, see rg::SceneGeometry
+layout (location = 5) in mat4 instanceModel;
+// its layer of the material texture array
+layout (location = 9) in uint instanceLayer;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+flat out uint Layer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
     Normal = aNormal;
-    TexCoords = aTexCoords;    
+    TexCoords = aTexCoords;
+    Layer = instanceLayer;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D luminance;
+uniform sampler2D previous;
+// mip of luminance that is a single texel
+uniform float lastLevel;
+uniform float deltaTime;
+uniform float speedUp;
+uniform float speedDown;
+uniform vec2 luminanceRange;
+
+// exponential approach of the adapted luminance to this frame's average, independent of frame rate
+void main() {
+    float current = clamp(exp(textureLod(luminance, vec2(0.5), lastLevel).r), luminanceRange.x, luminanceRange.y);
+    float adapted = texture(previous, vec2(0.5)).r;
+    float speed = current > adapted ? speedUp : speedDown;
+    adapted += (current - adapted) * (1.0 - exp(-deltaTime * speed));
+    FragColor = vec4(adapted, 0.0, 0.0, 1.0);
+}
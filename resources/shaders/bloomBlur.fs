@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+uniform vec2 texelSize;
+uniform bool horizontal;
+
+// KERNEL_TAPS, kernelOffsets and kernelWeights come from the prelude built by rg::BlurKernel.
+// Offsets past 0 sit between two texels so the linear filter fetches both at once.
+void main() {
+    vec2 direction = horizontal ? vec2(texelSize.x, 0.0) : vec2(0.0, texelSize.y);
+    vec3 result = texture(image, TexCoords).rgb * kernelWeights[0];
+    for (int i = 1; i < KERNEL_TAPS; ++i) {
+        result += texture(image, TexCoords + direction * kernelOffsets[i]).rgb * kernelWeights[i];
+        result += texture(image, TexCoords - direction * kernelOffsets[i]).rgb * kernelWeights[i];
+    }
+    FragColor = vec4(result, 1.0);
+}
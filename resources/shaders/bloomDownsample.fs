@@ -0,0 +1,35 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+// size of one texel of the level being read
+uniform vec2 texelSize;
+// set for the first pass, which reads the scene and keeps only what is brighter than threshold
+uniform bool brightPass;
+uniform float threshold;
+// the scene may only fill part of its texture, taps must not read past it
+uniform vec2 uvScale;
+uniform vec2 uvMax;
+
+vec3 fetch(vec2 uv) {
+    vec3 color = texture(image, min(uv, uvMax)).rgb;
+    if (brightPass) {
+        float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+        return brightness > threshold ? color : vec3(0.0);
+    }
+    return color;
+}
+
+// dual filter downsample: the center plus four bilinear taps on the texel corners,
+// each of which already averages a 2x2 block of the source
+void main() {
+    vec2 uv = TexCoords * uvScale;
+    vec3 result = fetch(uv) * 4.0;
+    result += fetch(uv + vec2(-texelSize.x, -texelSize.y));
+    result += fetch(uv + vec2( texelSize.x, -texelSize.y));
+    result += fetch(uv + vec2(-texelSize.x,  texelSize.y));
+    result += fetch(uv + vec2( texelSize.x,  texelSize.y));
+    FragColor = vec4(result / 8.0, 1.0);
+}
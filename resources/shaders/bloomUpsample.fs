@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+// filter radius in uv units of the level being read
+uniform vec2 texelSize;
+
+// 3x3 tent filter, added onto the larger level by additive blending
+void main() {
+    float x = texelSize.x;
+    float y = texelSize.y;
+    vec3 result = texture(image, TexCoords).rgb * 4.0;
+    result += (texture(image, TexCoords + vec2(-x, 0.0)).rgb + texture(image, TexCoords + vec2(x, 0.0)).rgb
+             + texture(image, TexCoords + vec2(0.0, -y)).rgb + texture(image, TexCoords + vec2(0.0, y)).rgb) * 2.0;
+    result += texture(image, TexCoords + vec2(-x, -y)).rgb + texture(image, TexCoords + vec2(x, -y)).rgb
+            + texture(image, TexCoords + vec2(-x, y)).rgb + texture(image, TexCoords + vec2(x, y)).rgb;
+    FragColor = vec4(result / 16.0, 1.0);
+}
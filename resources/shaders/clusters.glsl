@@ -0,0 +1,58 @@
+// Local lights assigned to clusters of the view frustum by rg::LightClusters, included with
+// #include "clusters.glsl" after frame.glsl and lighting.glsl.
+
+layout (std140) uniform LightClusters {
+    uvec4 clusterGrid;     // tiles x, tiles y, depth slices
+    vec4 clusterDepth;     // slice = log(view depth) * x + y, render area size in zw
+};
+
+uniform samplerBuffer clusterLights;      // six texels per light
+uniform usamplerBuffer clusterCells;      // offset and count in clusterIndices
+uniform usamplerBuffer clusterIndices;
+
+// takes a light smoothly to zero at its range, past which the clusters leave it out
+float RangeWindow(float distance, float range)
+{
+    float x = distance / range;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
+vec3 CalcClusteredLights(vec3 albedo, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    ivec3 cluster = ivec3(vec2(clusterGrid.xy) * gl_FragCoord.xy / clusterDepth.zw,
+                          log(max(depth, 1e-4)) * clusterDepth.x + clusterDepth.y);
+    cluster = clamp(cluster, ivec3(0), ivec3(clusterGrid.xyz) - 1);
+    uvec2 cell = texelFetch(clusterCells, (cluster.z * int(clusterGrid.y) + cluster.y) * int(clusterGrid.x) + cluster.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < cell.y; i++)
+    {
+        int texel = int(texelFetch(clusterIndices, int(cell.x + i)).r) * 6;
+        vec4 positionRange = texelFetch(clusterLights, texel);
+        float distance = length(positionRange.xyz - fragPos);
+        if (distance >= positionRange.w)
+            continue;
+        vec4 ambientConstant = texelFetch(clusterLights, texel + 1);
+        vec4 diffuseLinear = texelFetch(clusterLights, texel + 2);
+        vec4 specularQuadratic = texelFetch(clusterLights, texel + 3);
+        vec4 outerCutOffSpot = texelFetch(clusterLights, texel + 5);
+        float window = RangeWindow(distance, positionRange.w);
+        if (outerCutOffSpot.y > 0.5)
+        {
+            vec4 directionCutOff = texelFetch(clusterLights, texel + 4);
+            SpotLight light = SpotLight(positionRange.xyz, directionCutOff.xyz, directionCutOff.w, outerCutOffSpot.x,
+                                        ambientConstant.w, diffuseLinear.w, specularQuadratic.w,
+                                        ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb);
+            result += window * CalcSpotLight(light, albedo, normal, fragPos, viewDir);
+        }
+        else
+        {
+            PointLight light = PointLight(positionRange.xyz, ambientConstant.w, diffuseLinear.w, specularQuadratic.w,
+                                          ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb);
+            result += window * CalcPointLight(light, albedo, normal, fragPos, viewDir);
+        }
+    }
+    return result;
+}
@@ -7,15 +7,15 @@ in vec3 Normal;
 in vec3 FragPos;
 
 uniform sampler2D diffuse;
-uniform int i;
 uniform vec3 viewPosition;
 
 
+// TRANSLUCENT is defined for the program that draws the walls seen from inside the shuttle
 void main()
 {
     vec4 texColor=texture(diffuse,TexCoords);
-    if(i==0){
-        texColor.a=0.1;
-    }
+#ifdef TRANSLUCENT
+    texColor.a=0.1;
+#endif
     FragColor = texColor;
 }
\ No newline at end of file
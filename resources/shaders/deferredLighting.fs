@@ -0,0 +1,53 @@
+#version 330 core
+
+#include "frame.glsl"
+#include "lighting.glsl"
+#include "clusters.glsl"
+#include "gbuffer.glsl"
+
+layout (location = 0) out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+uniform PointLight pointLight;
+uniform SpotLight spotLight;
+
+// Lights the G-buffer once per pixel, with the same lights as the forward shaders: the sun,
+// the flashlight and the local lights of the cluster the pixel falls into.
+// FLASHLIGHT is defined for the program used while the flashlight is on
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    if (depth == 1.0)
+    {
+        // nothing was drawn here, the sky comes later
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    vec4 albedo = texelFetch(gAlbedo, texel, 0);
+    if (albedo.a > 0.5 * MaterialEmissive)
+    {
+        FragColor = vec4(albedo.rgb, 1.0);
+        return;
+    }
+
+    // the render area is in clusterDepth.zw
+    vec4 clip = vec4(gl_FragCoord.xy / clusterDepth.zw * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+    vec3 norm = DecodeNormal(texelFetch(gNormal, texel, 0).xy);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    vec3 result = CalcPointLight(pointLight,albedo.rgb,norm,fragPos,viewDir);
+    result+=CalcClusteredLights(albedo.rgb,norm,fragPos,viewDir);
+#ifdef FLASHLIGHT
+    result+=CalcSpotLight(spotLight,albedo.rgb,norm,fragPos,viewDir);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
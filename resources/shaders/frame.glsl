@@ -0,0 +1,7 @@
+// Constants of the whole frame, one uniform buffer range bound to FrameConstants
+// (binding point 0) and shared by every program that includes this.
+layout (std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
@@ -0,0 +1,29 @@
+// Layout of the G-buffer of the deferred path, included with #include "gbuffer.glsl" by the
+// shaders writing it and by deferredLighting.fs reading it:
+//   0 RGBA8   albedo, material id in alpha
+//   1 RG16F   normal, octahedral encoded
+// plus the scene depth, which the position is reconstructed from.
+
+// material ids
+const float MaterialLit = 0.0;
+const float MaterialEmissive = 1.0;   // the albedo is the color, no lighting
+
+vec2 SignNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// a unit vector onto the octahedron, folded into the [-1,1] square
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = clamp(-n.z, 0.0, 1.0);
+    n.xy -= fold * SignNotZero(n.xy);
+    return normalize(n);
+}
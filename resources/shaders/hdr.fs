@@ -6,37 +6,63 @@ in vec2 TexCoords;
 
 uniform sampler2D hdrBuffer;
 uniform sampler2D bloomBlur;
-uniform bool bloom;
-uniform bool hdr;
-uniform bool invert;
-uniform bool greyScale;
-uniform float exposure;
+uniform float bloomStrength;
+// 1x1 luminance the eye has adapted to, exposure maps it to keyValue before the compensation
+uniform sampler2D adaptedLuminance;
+uniform float keyValue;
+uniform float exposureCompensation;
+// part of hdrBuffer the scene was rendered into, and how much to sharpen when upscaling it
+uniform vec2 renderScale;
+uniform float sharpness;
 
+// Bilinear upscale of the rendered part of hdrBuffer. Below full resolution the four
+// neighbours sharpen it, and the result is clamped to their range so edges don't ring.
+vec3 sceneColor(){
+    vec2 texel = 1.0/vec2(textureSize(hdrBuffer,0));
+    vec2 uvMin = 0.5*texel;
+    vec2 uvMax = renderScale - 0.5*texel;
+    vec2 uv = clamp(TexCoords*renderScale,uvMin,uvMax);
+    vec3 center = texture(hdrBuffer,uv).rgb;
+    if(sharpness<=0.0){
+        return center;
+    }
+    vec3 north = texture(hdrBuffer,clamp(uv+vec2(0.0,texel.y),uvMin,uvMax)).rgb;
+    vec3 south = texture(hdrBuffer,clamp(uv-vec2(0.0,texel.y),uvMin,uvMax)).rgb;
+    vec3 east = texture(hdrBuffer,clamp(uv+vec2(texel.x,0.0),uvMin,uvMax)).rgb;
+    vec3 west = texture(hdrBuffer,clamp(uv-vec2(texel.x,0.0),uvMin,uvMax)).rgb;
+    vec3 lo = min(center,min(min(north,south),min(east,west)));
+    vec3 hi = max(center,max(max(north,south),max(east,west)));
+    vec3 sharpened = center + (4.0*center - north - south - east - west)*sharpness;
+    return clamp(sharpened,lo,hi);
+}
+
+// One program per combination of BLOOM with at most one of HDR, INVERT and GREYSCALE,
+// so the effect keys pick a program instead of every pixel testing them.
 void main(){
 
     const float gamma = 2.2;
-    vec3 hdrColor=texture(hdrBuffer,TexCoords).rgb;
-    vec3 bloomColor=texture(bloomBlur,TexCoords).rgb;
-    if(bloom){
-        hdrColor+=bloomColor;
-    }
-    if(hdr){
-        vec3 result = vec3(1.0) - exp(-hdrColor*exposure);
-        result=pow(result,vec3(1.0/gamma));
-        FragColor=vec4(result,1.0);
-    }
-    else if(invert){
-        FragColor=vec4(vec3(1.0 - texture(hdrBuffer, TexCoords)),1.0);
-    }
-    else if(greyScale){
-        FragColor=texture(hdrBuffer,TexCoords);
-        float average = (FragColor.r + FragColor.g + FragColor.b)/3;
-        FragColor=vec4(average,average,average,1.0);
-    }
-    else{
-        vec3 result = pow(hdrColor,vec3(1.0/gamma));
-        FragColor = vec4(result,1.0);
-    }
+#if defined(HDR) || !(defined(INVERT) || defined(GREYSCALE))
+    vec3 hdrColor=sceneColor();
+#ifdef BLOOM
+    // every level of the chain was added on top of mip 0
+    hdrColor+=texture(bloomBlur,TexCoords).rgb*bloomStrength;
+#endif
+#endif
+#if defined(HDR)
+    float exposure = keyValue/max(texture(adaptedLuminance,vec2(0.5)).r,1e-4)*exp2(exposureCompensation);
+    vec3 result = vec3(1.0) - exp(-hdrColor*exposure);
+    result=pow(result,vec3(1.0/gamma));
+    FragColor=vec4(result,1.0);
+#elif defined(INVERT)
+    FragColor=vec4(vec3(1.0) - sceneColor(),1.0);
+#elif defined(GREYSCALE)
+    FragColor=vec4(sceneColor(),1.0);
+    float average = (FragColor.r + FragColor.g + FragColor.b)/3;
+    FragColor=vec4(average,average,average,1.0);
+#else
+    vec3 result = pow(hdrColor,vec3(1.0/gamma));
+    FragColor = vec4(result,1.0);
+#endif
 
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D hdrBuffer;
+// part of hdrBuffer the scene was rendered into
+uniform vec2 uvScale;
+
+// log luminance, so averaging it down the mip chain gives the log of the geometric mean
+void main() {
+    vec3 color = texture(hdrBuffer, TexCoords * uvScale).rgb;
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    FragColor = vec4(log(max(luminance, 1e-4)), 0.0, 0.0, 1.0);
+}
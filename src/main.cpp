@@ -14,8 +14,34 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 #include <rg/Error.h>
+#include <rg/SpatialIndex.h>
+#include <rg/OcclusionCulling.h>
+#include <rg/SceneGraph.h>
+#include <rg/EntityStore.h>
+#include <rg/Bloom.h>
+#include <rg/BlurKernel.h>
+#include <rg/DynamicResolution.h>
+#include <rg/FrameGraph.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/AutoExposure.h>
+#include <rg/Headless.h>
+#include <rg/FrameRecorder.h>
+#include <rg/Profiler.h>
+#include <rg/TraceRecorder.h>
+#include <rg/GLExtensions.h>
+#include <rg/StreamBuffer.h>
+#include <rg/SceneGeometry.h>
+#include <rg/TextureArray.h>
+#include <rg/RenderQueue.h>
+#include <rg/LightClusters.h>
+#include <rg/NBody.h>
+#include <rg/Collision.h>
 
 #include <iostream>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -29,19 +55,47 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 
 int getRandNumber(int min,int max);
 
-void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 diffuse,glm::vec3 ambient,float constant,float linear,float quadratic,glm::mat4 projection,glm::mat4 view,glm::vec3 camPosition,bool point_spot,float cutOff,float outerCutoff,glm::vec3 direction);
+void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 diffuse,glm::vec3 ambient,float constant,float linear,float quadratic,bool point_spot,float cutOff,float outerCutoff,glm::vec3 direction);
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 
+int runBenchmark(const std::string &name);
+
+float currentTime();
+
+void setViewpoint(int viewpoint,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition);
+
+void scriptedCamera(float time,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition,float beltRadius);
+
+std::string summaryPath(const std::string &csvPath);
+
+void drawProfilerPanel(const rg::Profiler &profiler);
+
+struct ModelRadius {
+    float bounding;
+    float occluder;
+};
+
+ModelRadius measureModel(const Model &model);
+
 // settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
+int framebufferWidth=SCR_WIDTH;
+int framebufferHeight=SCR_HEIGHT;
+bool dynamicResolution=true;
+bool dumpFrameGraph=false;
+bool showProfiler=false;
+bool traceRequested=false;
 bool hdr=false;
 bool invert=false;
 bool bloom=false;
-bool FlashLight=true;
+int bloomRadius=4;
+bool bloomRadiusChanged=false;
+bool FlashLight=false;
+bool deferredShading=false;
 bool greyScale=false;
-float exposure=1.0f;
+float exposureCompensation=0.0f;   // EV on top of the automatic exposure
 bool inShuttle=true;
 glm::vec3 shuttlePosition;
 
@@ -55,6 +109,12 @@ bool firstMouse = true;
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+// glfwGetTime would need glfwInit, which needs a display even when running headless
+rg::Stopwatch startupClock;
+// benchmark runs advance time by a fixed step per frame instead
+bool fixedClock=false;
+int clockFrame=0;
+const float FixedTimeStep=1.0f/60.0f;
 
 Camera camera (glm::vec3(0.0f, 35.0f, 0.0f));
 bool CameraMouseMovementUpdateEnabled = true;
@@ -65,17 +125,6 @@ glm::vec3 spec;
 glm::vec3 ambientSpot=glm::vec3(0.0f);
 glm::vec3 diffuseSpot=dif;
 glm::vec3 specularSpot=spec;
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
 struct SpotLight {
     glm::vec3 position;
     glm::vec3 direction;
@@ -93,74 +142,279 @@ struct SpotLight {
 
 
 
-struct PlanetsInfo{
-    glm::vec3 sunPosition = glm::vec3(0.0f);
-    float sunScale = 2.0f;
-    float sunRotationSpeed=0.03;
+enum ModelId {
+    SUN_MODEL,
+    EARTH_MODEL,
+    MOON_MODEL,
+    SATURN_MODEL,
+    ROCK_MODEL
+};
+
+enum ShaderId {
+    SUN_SHADER,
+    PLANET_SHADER,
+    ROCK_SHADER
+};
+
+// feature bits of the shader permutations, in the order their names are given to rg::ShaderPermutations
+enum PostFeature {
+    POST_BLOOM = 1 << 0,
+    POST_HDR = 1 << 1,
+    POST_INVERT = 1 << 2,
+    POST_GREYSCALE = 1 << 3
+};
+
+enum LightingFeature {
+    LIGHTING_FLASHLIGHT = 1 << 0,
+    LIGHTING_DEFERRED = 1 << 1
+};
+
+enum ShuttleFeature {
+    SHUTTLE_TRANSLUCENT = 1 << 0
+};
 
-    float earthScale=0.6f;
-    glm::vec3 earthPosition=glm::vec3(55,0,0);
-    float earthRotationSpeed=0.04;
-    float earthDistance=earthPosition.x;
+// uniform buffer binding points
+const unsigned int FrameConstantsBinding=0;
+const unsigned int LightClustersBinding=1;
 
-    float moonScale=0.2f;
-    float moonRotationSpeed=0.3;
+// planes of the scene projection
+const float nearPlane=0.1f;
+const float farPlane=300.0f;
 
+// Draws after the opaque ones in the render queue, their entry values.
+enum CustomDraw {
+    NO_CUSTOM_DRAW,
+    SKYBOX_DRAW,
+    SHUTTLE_DRAW
+};
 
-    float SaturnScale=1.35f;
-    glm::vec3 SaturnPositon=glm::vec3(100.0f,0.0f,0.0f);
-    float SaturnRotationSpeed=0.01;
-    float SaturnDistance=SaturnPositon.x;
+// One mesh instance of the scene geometry, an opaque entry of the render queue points at it.
+struct SceneDraw {
+    Shader *shader;
+    const char *name;
+    bool cullBackFaces;
+    unsigned int mesh;
+    rg::SceneGeometry::Instance instance;
+};
+
+// Scene draws that share a program and culling and are next to each other in the sorted render
+// queue, submitted together; their materials are layers of one texture array. Custom draws are
+// batches of their own.
+struct DrawBatch {
+    Shader *shader;
+    const char *name;       // profiler scope
+    bool cullBackFaces;
+    std::vector<rg::SceneGeometry::DrawCommand> commands;
+    CustomDraw customDraw;
+};
+
+// std140 layout of the FrameConstants block in frame.glsl
+struct FrameConstants {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPosition;
+};
+
+// One row per body of the solar system, bodies are spawned as entities from this table.
+struct BodyDescription {
+    const char *name;
+    int parent;             // row of the body this one orbits, -1 for the sun
+    ModelId model;
+    ShaderId shader;
+    float scale;
+    float orbitDistance;
+    float orbitSpeed;
+    float spinSpeed;
+    glm::vec3 spinAxis;
+    bool occluder;          // big enough to hide things for the occlusion culling
+};
+
+const BodyDescription bodies[] = {
+        // name     parent  model         shader         scale  distance speed  spin   spin axis                 occluder
+        {"Sun",     -1,     SUN_MODEL,    SUN_SHADER,    2.0f,  0.0f,    0.0f,  0.03f, glm::vec3(0.0f,-1.0f,0.0f), true},
+        {"Earth",   0,      EARTH_MODEL,  PLANET_SHADER, 0.6f,  55.0f,   0.04f, 0.5f,  glm::vec3(0.0f,1.0f,0.0f),  true},
+        {"Moon",    1,      MOON_MODEL,   PLANET_SHADER, 0.2f,  3.0f,    1.0f,  0.7f,  glm::vec3(0.0f,1.0f,0.0f),  false},
+        {"Saturn",  0,      SATURN_MODEL, PLANET_SHADER, 1.35f, 100.0f,  0.01f, 0.1f,  glm::vec3(0.0f,1.0f,0.0f),  true},
+};
+const int EARTH=1;
+const int SATURN=3;
 
+struct AsteroidBelt{
+    int parent=SATURN;
     int numberOfAsteroids=200;
     float radius=20.0f;
     int offset=3;
     int yOffset=1;
+    // gravity of the rg::NBody belt, G is 1: rocks at radius go round in about 20 s
+    float planetMass=720.0f;
+    float rockMass=1e-3f;
+    // the first two rocks, orbiting the inner and outer edge of the belt
+    int moonlets=2;
+    float moonletMass=2.0f;
+    float moonletScale=2.0f;
+    // of the rocks' collisions with each other and the shuttle
+    float restitution=0.5f;
+};
 
+// One run of --shading-sweep: the scripted frames with that many local lights on one path.
+struct ShadingSweepRun {
+    int lights;
+    bool deferred;
+    rg::FrameRecorder::Summary cpu;
+    rg::FrameRecorder::Summary gpu;
 };
 
-void processInput(GLFWwindow *window,PlanetsInfo Info);
+void processInput(GLFWwindow *window,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition);
+
+int main(int argc, char **argv) {
+    // CPU-only benchmarks don't need a window
+    if (argc > 2 && std::string(argv[1]) == "--bench")
+        return runBenchmark(argv[2]);
+
+    // --headless renders --frames frames into an offscreen framebuffer of --size WxH through a
+    // surfaceless EGL context, no window or display needed; --screenshot writes the last one.
+    // --benchmark runs --warmup + --frames frames on a fixed clock and seed along a scripted
+    // camera path and writes the frame times to --csv, windowed or headless.
+    // --trace writes --trace-frames frames from frame --trace-start on as a Chrome trace.
+    // --no-extensions keeps to the OpenGL 3.3 paths even where the driver has more.
+    // --lights puts that many beacons on the asteroids, local lights for the light clusters.
+    // --asteroids sets how many rocks the belt simulation moves.
+    // --deferred starts on the deferred shading path; --shading-sweep repeats the benchmark run
+    // with forward and deferred shading at a growing number of those lights.
+    bool headless=false;
+    bool benchmark=false;
+    bool noExtensions=false;
+    int frameCount=-1;
+    int warmupFrames=60;
+    unsigned int seed=1;
+    std::string screenshotPath;
+    std::string csvPath="benchmark.csv";
+    std::string tracePath;
+    int traceFrames=120;
+    int traceStart=-1;
+    int lightCount=256;
+    int asteroidCount=AsteroidBelt().numberOfAsteroids;
+    bool shadingSweep=false;
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--headless")
+            headless=true;
+        else if(arg=="--benchmark")
+            benchmark=true;
+        else if(arg=="--frames" && i+1<argc)
+            frameCount=atoi(argv[++i]);
+        else if(arg=="--warmup" && i+1<argc)
+            warmupFrames=atoi(argv[++i]);
+        else if(arg=="--seed" && i+1<argc)
+            seed=(unsigned int)atoi(argv[++i]);
+        else if(arg=="--csv" && i+1<argc)
+            csvPath=argv[++i];
+        else if(arg=="--trace" && i+1<argc)
+            tracePath=argv[++i];
+        else if(arg=="--trace-frames" && i+1<argc)
+            traceFrames=atoi(argv[++i]);
+        else if(arg=="--trace-start" && i+1<argc)
+            traceStart=atoi(argv[++i]);
+        else if(arg=="--size" && i+1<argc)
+            sscanf(argv[++i],"%dx%d",&framebufferWidth,&framebufferHeight);
+        else if(arg=="--screenshot" && i+1<argc)
+            screenshotPath=argv[++i];
+        else if(arg=="--bloom")
+            bloom=true;
+        else if(arg=="--hdr")
+            hdr=true;
+        else if(arg=="--fixed-resolution")
+            dynamicResolution=false;
+        else if(arg=="--no-extensions")
+            noExtensions=true;
+        else if(arg=="--lights" && i+1<argc)
+            lightCount=atoi(argv[++i]);
+        else if(arg=="--asteroids" && i+1<argc)
+            asteroidCount=std::max(atoi(argv[++i]),0);
+        else if(arg=="--deferred")
+            deferredShading=true;
+        else if(arg=="--shading-sweep")
+            shadingSweep=true;
+    }
+    if(shadingSweep)
+        benchmark=true;
+    if(frameCount<0)
+        frameCount=shadingSweep ? 300 : benchmark ? 1200 : 300;
+    if(traceStart<0)
+        traceStart=benchmark ? warmupFrames : 0;
+    if(benchmark){
+        // nothing that reacts to timing may change the work between runs
+        fixedClock=true;
+        dynamicResolution=false;
+    }
 
-int main() {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window=nullptr;
+    std::unique_ptr<rg::HeadlessContext> headlessContext;
+    if(headless){
+        headlessContext.reset(new rg::HeadlessContext(framebufferWidth,framebufferHeight));
+        if(!headlessContext->ready())
+            return -1;
+    }
+    else{
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwGetFramebufferSize(window,&framebufferWidth,&framebufferHeight);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        if(benchmark){
+            // the camera follows the script and the frame rate isn't capped by vsync
+            glfwSwapInterval(0);
+        }
+        else{
+            glfwSetCursorPosCallback(window, mouse_callback);
+            glfwSetScrollCallback(window, scroll_callback);
+            glfwSetKeyCallback(window, key_callback);
+            // tell GLFW to capture our mouse
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        }
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+
+        // imgui: the profiler panel, drawn over the finished frame; our own callbacks stay
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui::GetIO().IniFilename=nullptr;
+        ImGui::StyleColorsDark();
+        ImGui_ImplGlfw_InitForOpenGL(window,false);
+        ImGui_ImplOpenGL3_Init("#version 330 core");
     }
+    rg::loadGLExtensions(headless ? rg::HeadlessContext::loader() : (GLADloadproc) glfwGetProcAddress,noExtensions);
+    // the default framebuffer, or the one standing in for it
+    unsigned int presentFramebuffer=headless ? headlessContext->framebuffer() : 0;
 
     // tell stb_image.h to flip loaded textureColorBuffer's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
 
 
-    PlanetsInfo Info;
+    AsteroidBelt belt;
+    belt.numberOfAsteroids=asteroidCount;
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
@@ -168,12 +422,19 @@ int main() {
 
     //Load shaders---------------------------------------
     Shader sunShader("resources/shaders/Sun.vs", "resources/shaders/Sun.fs");
-    Shader planetShader("resources/shaders/planetShader.vs", "resources/shaders/planetShader.fs");
     Shader skyboxShader("resources/shaders/skybox.vs","resources/shaders/skybox.fs");
-    Shader rockShader("resources/shaders/Rocks.vs","resources/shaders/Rocks.fs");
-    Shader hdrShader("resources/shaders/hdr.vs","resources/shaders/hdr.fs");
-    Shader cubeShuttleShader("resources/shaders/cubeShuttle.vs","resources/shaders/cubeShuttle.fs");
-    Shader blurShader("resources/shaders/blur.vs","resources/shaders/blur.fs");
+    // the effect and flashlight toggles pick one of these instead of setting bool uniforms
+    rg::ShaderPermutations planetShaders("resources/shaders/planetShader.vs","resources/shaders/planetShader.fs",{"FLASHLIGHT","DEFERRED"});
+    rg::ShaderPermutations rockShaders("resources/shaders/Rocks.vs","resources/shaders/Rocks.fs",{"FLASHLIGHT","DEFERRED"});
+    rg::ShaderPermutations deferredLightingShaders("resources/shaders/bloom.vs","resources/shaders/deferredLighting.fs",{"FLASHLIGHT"});
+    rg::ShaderPermutations hdrShaders("resources/shaders/hdr.vs","resources/shaders/hdr.fs",{"BLOOM","HDR","INVERT","GREYSCALE"});
+    rg::ShaderPermutations cubeShuttleShaders("resources/shaders/cubeShuttle.vs","resources/shaders/cubeShuttle.fs",{"TRANSLUCENT"});
+    Shader bloomDownsampleShader("resources/shaders/bloom.vs","resources/shaders/bloomDownsample.fs");
+    Shader bloomUpsampleShader("resources/shaders/bloom.vs","resources/shaders/bloomUpsample.fs");
+    // the Gaussian is baked into the shader, so it's rebuilt whenever the radius changes
+    Shader bloomBlurShader("resources/shaders/bloom.vs","resources/shaders/bloomBlur.fs",rg::BlurKernel::linear(bloomRadius,bloomRadius/2.0f).glslConstants());
+    Shader luminanceShader("resources/shaders/bloom.vs","resources/shaders/luminance.fs");
+    Shader adaptExposureShader("resources/shaders/bloom.vs","resources/shaders/adaptExposure.fs");
 
     float rockVertices[] ={
             //front
@@ -204,27 +465,19 @@ int main() {
             9,10,11
     };
 
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(rockVertices), rockVertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3*sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5*sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // into the layout of Mesh, for the scene geometry buffer
+    std::vector<Vertex> rockMeshVertices;
+    for(unsigned int i=0;i<sizeof(rockVertices)/sizeof(float);i+=8){
+        Vertex vertex{};
+        vertex.Position=glm::vec3(rockVertices[i],rockVertices[i+1],rockVertices[i+2]);
+        vertex.TexCoords=glm::vec2(rockVertices[i+3],rockVertices[i+4]);
+        vertex.Normal=glm::vec3(rockVertices[i+5],rockVertices[i+6],rockVertices[i+7]);
+        rockMeshVertices.push_back(vertex);
+    }
+    std::vector<unsigned int> rockMeshIndices(indices,indices+sizeof(indices)/sizeof(indices[0]));
 
 
     unsigned int rockTexDiffuse = loadTexture("resources/textures/rock/tileable1b.png");
-    unsigned int rockTexSpecular = loadTexture("resources/textures/rock/tileable1c.png");
 
 
     float cubeShuttleVertices[] = {
@@ -295,54 +548,16 @@ int main() {
 
     //Hdr framebuffer(used for other effects also)--------------------------------------
 
-    unsigned int hdrFBO;
-    glGenFramebuffers(1,&hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER,hdrFBO);
-    unsigned int collorBuffer[2];
-    glGenTextures(2,collorBuffer);
-    for(int i=0;i<2;i++) {
-        glBindTexture(GL_TEXTURE_2D, collorBuffer[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0+i,GL_TEXTURE_2D,collorBuffer[i],0);
-    }
-    unsigned int rboDepth;
-    glGenRenderbuffers(1,&rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER,rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT,SCR_WIDTH,SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,rboDepth);
-
-    unsigned int attachment[2] = {GL_COLOR_ATTACHMENT0,GL_COLOR_ATTACHMENT1};
-    glDrawBuffers(2,attachment);
-
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE){
-        ASSERT(false,"Framebuffer not complete!");
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER,0);
-
-
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorBuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorBuffers);
-    for (unsigned int i = 0; i < 2; ++i) {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorBuffers[i], 0);
-        if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE){
-            ASSERT(false,"Framebuffer not complete!");
-        }
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Render targets come from the pool, sized by the framebuffer each frame. With dynamic
+    // resolution the scene is drawn into the lower left part of a full size target and
+    // upscaled by hdr.fs.
+    rg::RenderTargetPool targets;
+    rg::FrameGraph frameGraph(targets);
+    rg::Bloom bloomChain;
+    rg::AutoExposure autoExposure;
+
 
+    rg::DynamicResolution renderScale;
 
 
     float quadVertices[] = {
@@ -439,20 +654,59 @@ int main() {
 
     skyboxShader.use();
     skyboxShader.setInt("skybox",0);
+    sunShader.use();
+    sunShader.setInt("materials",0);
+    sunShader.setUniformBlock("FrameConstants",FrameConstantsBinding);
 
-    rockShader.use();
-    rockShader.setInt("diffuseMap",0);
-    rockShader.setInt("specularMap",1);
-
-    cubeShuttleShader.use();
-    cubeShuttleShader.setInt("diffuse",0);
-
-    blurShader.use();
-    blurShader.setInt("image",0);
-
-    hdrShader.use();
-    hdrShader.setInt("hdrBuffer",0);
-    hdrShader.setInt("bloomBlur",1);
+    // units 1-3 are the light cluster buffer textures, see rg::LightClusters::bind
+    auto setUpLitShader=[](Shader &shader){
+        shader.use();
+        shader.setInt("materials",0);
+        shader.setInt("clusterLights",1);
+        shader.setInt("clusterCells",2);
+        shader.setInt("clusterIndices",3);
+        shader.setUniformBlock("FrameConstants",FrameConstantsBinding);
+        shader.setUniformBlock("LightClusters",LightClustersBinding);
+    };
+    planetShaders.setup=setUpLitShader;
+    rockShaders.setup=setUpLitShader;
+    // units 4-6 are the G-buffer
+    deferredLightingShaders.setup=[setUpLitShader](Shader &shader){
+        setUpLitShader(shader);
+        shader.setInt("gAlbedo",4);
+        shader.setInt("gNormal",5);
+        shader.setInt("gDepth",6);
+    };
+    cubeShuttleShaders.setup=[](Shader &shader){
+        shader.use();
+        shader.setInt("diffuse",0);
+    };
+    hdrShaders.setup=[](Shader &shader){
+        shader.use();
+        shader.setInt("hdrBuffer",0);
+        shader.setInt("bloomBlur",1);
+        shader.setInt("adaptedLuminance",2);
+    };
+    planetShaders.precompile({0,LIGHTING_FLASHLIGHT,LIGHTING_DEFERRED});
+    rockShaders.precompile({0,LIGHTING_FLASHLIGHT,LIGHTING_DEFERRED});
+    deferredLightingShaders.precompile({0,LIGHTING_FLASHLIGHT});
+    cubeShuttleShaders.precompile({0,SHUTTLE_TRANSLUCENT});
+    // bloom combines with any effect, the effects exclude each other
+    const unsigned int postEffects[]={0,POST_HDR,POST_INVERT,POST_GREYSCALE};
+    for(unsigned int effect : postEffects)
+        hdrShaders.precompile({effect,effect|POST_BLOOM});
+
+    bloomDownsampleShader.use();
+    bloomDownsampleShader.setInt("image",0);
+    bloomUpsampleShader.use();
+    bloomUpsampleShader.setInt("image",0);
+    bloomBlurShader.use();
+    bloomBlurShader.setInt("image",0);
+    luminanceShader.use();
+    luminanceShader.setInt("hdrBuffer",0);
+    adaptExposureShader.use();
+    adaptExposureShader.setInt("luminance",0);
+    adaptExposureShader.setInt("previous",1);
 
 
     // load models----------------------------------------------
@@ -462,18 +716,43 @@ int main() {
     Model moonModel("resources/objects/moon/Moon 2K.obj");
     Model SaturnModel("resources/objects/Saturn/Saturn.obj");
 
+    Model *models[]={&sunModel,&earthModel,&moonModel,&SaturnModel};
+    Shader *shaders[]={&sunShader,nullptr,nullptr};
+
+    // every opaque mesh in one buffer, indexed by ModelId
+    rg::SceneGeometry sceneGeometry;
+    unsigned int firstMesh[ROCK_MODEL+1];
+    for(int m=SUN_MODEL;m<ROCK_MODEL;m++)
+        firstMesh[m]=sceneGeometry.add(models[m]->meshes);
+    firstMesh[ROCK_MODEL]=sceneGeometry.add(rockMeshVertices,rockMeshIndices);
+    sceneGeometry.upload();
+    // the diffuse texture of every mesh as a layer of one array, indexed by scene geometry mesh id
+    rg::TextureArray materials(2048,1024);
+    std::vector<unsigned int> meshLayers;
+    for(int m=SUN_MODEL;m<ROCK_MODEL;m++){
+        for(const Mesh &mesh : models[m]->meshes){
+            unsigned int layer=rg::TextureArray::WhiteLayer;
+            for(const Texture &texture : mesh.textures){
+                if(texture.type==TextureType::Diffuse){
+                    layer=materials.add(texture.id);
+                    break;
+                }
+            }
+            meshLayers.push_back(layer);
+        }
+    }
+    meshLayers.push_back(materials.add(rockTexDiffuse));
+    materials.upload();
+    rg::RenderQueue renderQueue;
+    std::vector<SceneDraw> sceneDraws;
+    std::vector<DrawBatch> batches;
+    std::vector<rg::SceneGeometry::Instance> instances;
 
-    //Light init--------------------------------------------------
-    PointLight pointLight;
-    pointLight.position = glm::vec3(0.0f,0.0f,0.0f);
-    pointLight.ambient = glm::vec3(0.8);
-    pointLight.diffuse = glm::vec3(6.0f);
-    pointLight.specular = glm::vec3(2);
-
-    pointLight.constant = 1.0f;
-    pointLight.linear = 0.09f;
-    pointLight.quadratic = 0.032f;
+    //Occlusion culling----------------------------------------
+    rg::DepthRasterizer occlusion(320,180);
+    rg::OccluderMesh occluderSphere=rg::OccluderMesh::sphere(1.0f,12,16);
 
+    //Light init--------------------------------------------------
     SpotLight spotLight;
     spotLight.position=glm::vec3(0.0f);
     spotLight.direction=glm::vec3(0.0f);
@@ -487,228 +766,753 @@ int main() {
     spotLight.specular=specularSpot;
 
 
-    std::vector<float>radiusWithOffset(Info.numberOfAsteroids);
-    std::vector<float>yDisplacement(Info.numberOfAsteroids);
-    std::vector<float>angle(Info.numberOfAsteroids);
-
-
+    std::vector<rg::AABB>rockBounds(belt.numberOfAsteroids);
+    std::vector<float>rockRadii(belt.numberOfAsteroids);
+    std::vector<rg::Sphere>rockSpheres(belt.numberOfAsteroids);
+    std::vector<rg::Contact>rockContacts,shuttleContacts;
+    rg::SpatialHashGrid rockGrid;
+    std::vector<int>visibleRocks;
+    visibleRocks.reserve(belt.numberOfAsteroids);
+    rg::BVH rockBVH;
+    // rock vertices lie within the unit cube, scaled by 0.8 when drawn
+    const float rockRadius = 0.8f * 0.87f;
+
+
+    //Bodies and asteroids are entities; their transforms hang off the scene graph: -----------
+    // solar system -> orbit pivot -> body, children of a body orbit its pivot
+    rg::EntityStore store;
+    rg::SceneGraph scene;
+    rg::JobSystem jobs;
+    rg::SceneGraph::Node solarSystemNode=scene.createNode();
+    const int numberOfBodies=sizeof(bodies)/sizeof(bodies[0]);
+    rg::Entity bodyEntities[numberOfBodies];
+    for(int i=0;i<numberOfBodies;i++){
+        const BodyDescription &description=bodies[i];
+        unsigned int components=rg::TransformComponent | rg::RenderableComponent;
+        if(description.parent>=0)
+            components|=rg::OrbitComponent;
+        if(description.parent<0)
+            components|=rg::LightComponent;
+        rg::Entity entity=store.create(components);
+        bodyEntities[i]=entity;
+
+        rg::SceneGraph::Node parentPivot=description.parent<0 ? solarSystemNode : store.transform(bodyEntities[description.parent]).pivot;
+        rg::Transform &transform=store.transform(entity);
+        transform.pivot=scene.createNode(parentPivot);
+        transform.body=scene.createNode(transform.pivot);
+        transform.spinAxis=description.spinAxis;
+        transform.spinSpeed=description.spinSpeed;
+        scene.setScale(transform.body,description.scale);
+
+        if(components & rg::OrbitComponent){
+            store.orbit(entity).distance=description.orbitDistance;
+            store.orbit(entity).speed=description.orbitSpeed;
+        }
 
-    for(int i=0;i<Info.numberOfAsteroids;i++){
-        int randNumber=getRandNumber(-Info.offset,Info.offset);
-        int randNumber2= getRandNumber(-Info.yOffset,Info.yOffset);
-        radiusWithOffset[i]=Info.radius + (float)randNumber;
-        yDisplacement[i]=(float)randNumber2;
-        angle[i]=glm::radians(glfwGetTime() * getRandNumber(0,100)*0.1);
+        ModelRadius radius=measureModel(*models[description.model]);
+        rg::Renderable &renderable=store.renderable(entity);
+        renderable.model=description.model;
+        renderable.shader=description.shader;
+        renderable.boundingRadius=description.scale*radius.bounding;
+        renderable.occluderRadius=description.occluder ? radius.occluder : 0.0f;
     }
 
-
-    srand(glfwGetTime());
+    // the sun is the scene's point light
+    rg::Light &sunLight=store.light(bodyEntities[0]);
+    sunLight.ambient = glm::vec3(0.8);
+    sunLight.diffuse = glm::vec3(6.0f);
+    sunLight.specular = glm::vec3(2);
+    sunLight.constant = 1.0f;
+    sunLight.linear = 0.09f;
+    sunLight.quadratic = 0.032f;
+
+    srand(seed);
+    // The rocks are moved by gravity: Saturn, the moonlets and the rocks are particles of an
+    // N-body system in the frame of Saturn's orbit pivot, which the belt node hangs off.
+    rg::SceneGraph::Node beltNode=scene.createNode(store.transform(bodyEntities[belt.parent]).pivot);
+    rg::NBody gravity;
+    unsigned int planetParticle=gravity.add(glm::vec3(0.0f),glm::vec3(0.0f),belt.planetMass);
+    std::vector<rg::Entity>rockEntities(belt.numberOfAsteroids);
+    std::vector<unsigned int>rockParticles(belt.numberOfAsteroids);
+    for(int i=0;i<belt.numberOfAsteroids;i++){
+        rg::Entity entity=store.create(rg::TransformComponent | rg::RenderableComponent);
+        rockEntities[i]=entity;
+        bool moonlet=i<belt.moonlets;
+        rg::Transform &transform=store.transform(entity);
+        transform.pivot=transform.body=scene.createNode(beltNode);
+        transform.spinAxis=glm::vec3(0.4f, 0.6f,0.8f);
+        transform.spinSpeed=glm::radians(getRandNumber(0,100)*0.1f);
+        scene.setScale(transform.body,moonlet ? belt.moonletScale : 0.8f);
+        rockRadii[i]=moonlet ? rockRadius*belt.moonletScale/0.8f : rockRadius;
+
+        // on a circular orbit, moonlets just inside and outside the belt
+        float distance=belt.radius + (float)getRandNumber(-belt.offset,belt.offset);
+        float height=(float)getRandNumber(-belt.yOffset,belt.yOffset);
+        if(moonlet){
+            distance=belt.radius+(i%2 ? 1.0f : -1.0f)*(belt.offset+1.5f);
+            height=0.0f;
+        }
+        float angle=glm::radians((float)getRandNumber(0,359));
+        glm::vec3 position(distance*cos(angle),height,distance*sin(angle));
+        float speed=sqrt(gravity.G*belt.planetMass/glm::length(position))*distance/glm::length(position);
+        rockParticles[i]=gravity.add(position,speed*glm::vec3(-sin(angle),0.0f,cos(angle)),moonlet ? belt.moonletMass : belt.rockMass);
+        transform.position=position;
+
+        rg::Renderable &renderable=store.renderable(entity);
+        renderable.model=ROCK_MODEL;
+        renderable.shader=ROCK_SHADER;
+        renderable.boundingRadius=rockRadii[i];
+    }
+    // beacons on the asteroids, every fourth one a floodlight pointing away from its rock
+    const glm::vec3 beaconColors[]={glm::vec3(1.0f,0.3f,0.2f),glm::vec3(0.3f,0.6f,1.0f),glm::vec3(0.4f,1.0f,0.5f),glm::vec3(1.0f,0.8f,0.4f)};
+    for(int i=0;i<lightCount && belt.numberOfAsteroids>0;i++){
+        rg::Entity entity=store.create(rg::TransformComponent | rg::LightComponent);
+        rg::Transform &transform=store.transform(entity);
+        transform.pivot=scene.createNode(store.transform(rockEntities[i%belt.numberOfAsteroids]).body);
+        // somewhere on the surface, +y of the node points away from the rock
+        float angle=glm::radians((float)getRandNumber(0,180));
+        float heading=glm::radians((float)getRandNumber(0,359));
+        glm::vec3 axis(glm::cos(heading),0.0f,glm::sin(heading));
+        scene.setRotation(transform.pivot,angle,axis);
+        transform.position=glm::vec3(glm::rotate(glm::mat4(1.0f),angle,axis)*glm::vec4(0.0f,1.2f,0.0f,0.0f));
+        rg::Light &light=store.light(entity);
+        glm::vec3 color=beaconColors[getRandNumber(0,3)];
+        light.ambient=glm::vec3(0.0f);
+        light.diffuse=2.0f*color;
+        light.specular=color;
+        light.constant=1.0f;
+        light.linear=0.7f;
+        light.quadratic=1.8f;
+        light.range=3.0f;
+        if(i%4==3){
+            light.spot=true;
+            light.cutOff=glm::cos(glm::radians(20.0f));
+            light.outerCutOff=glm::cos(glm::radians(30.0f));
+            light.linear=0.22f;
+            light.quadratic=0.2f;
+            light.range=8.0f;
+        }
+    }
+    rg::LightClusters lightClusters(nearPlane,farPlane);
+    std::vector<rg::ClusterLight> clusterLights;
+    glm::vec3 earthPosition=bodies[EARTH].orbitDistance*glm::vec3(1.0f,0.0f,0.0f);
+    glm::vec3 SaturnPosition=bodies[SATURN].orbitDistance*glm::vec3(1.0f,0.0f,0.0f);
+
+    // the sweep runs the script forward and then deferred at each light count, up to all of them
+    std::vector<int> sweepLights;
+    if(shadingSweep)
+        sweepLights={0,lightCount/16,lightCount/4,lightCount};
+    std::vector<ShadingSweepRun> sweepRuns;
+    int activeLights=lightCount;
+    // and the belt from where it started
+    rg::NBody sweepStart;
+    if(shadingSweep)
+        sweepStart=gravity;
+
+    std::unique_ptr<rg::FrameRecorder> recorder;
+    if(benchmark){
+        recorder.reset(new rg::FrameRecorder());
+        std::cout<<"Benchmark: "<<warmupFrames<<" warmup + "<<frameCount<<" frames at "<<framebufferWidth<<"x"
+                 <<framebufferHeight<<", seed "<<seed;
+        if(shadingSweep)
+            std::cout<<", forward and deferred shading at "<<sweepLights.size()<<" light counts";
+        std::cout<<std::endl;
+    }
+    int runFrames=warmupFrames+frameCount;
+    int lastFrameIndex=benchmark ? runFrames*(shadingSweep ? 2*(int)sweepLights.size() : 1) : frameCount;
 
     // render loop ---------------------
 
-    while (!glfwWindowShouldClose(window)) {
+    // per-frame constants and instance data, written where the GPU reads them; a frame can draw
+    // every mesh of every body and rock, an instance and at worst a command each, the rest is
+    // the uniform blocks and headroom
+    size_t maxSceneInstances=belt.numberOfAsteroids;
+    for(int i=0;i<numberOfBodies;i++)
+        maxSceneInstances+=models[bodies[i].model]->meshes.size();
+    rg::StreamBuffer streamBuffer(256*1024+(GLsizeiptr)(maxSceneInstances*(sizeof(rg::SceneGeometry::Instance)+sizeof(rg::SceneGeometry::DrawCommand))));
+
+    rg::TraceRecorder trace;
+    rg::Profiler profiler;
+    profiler.trace=&trace;
+    jobs.trace=&trace;
+    int frame=0;
+    rg::Stopwatch runTime;
+    while ((headless || benchmark) ? frame<lastFrameIndex : !glfwWindowShouldClose(window)) {
+        if(framebufferWidth==0 || framebufferHeight==0){
+            // minimized, nothing to draw or record until the window comes back
+            glfwWaitEvents();
+            continue;
+        }
 
-        float currentFrame = glfwGetTime();
+        // frame of the current benchmark run, the script starts over with every sweep run
+        int runFrame=benchmark ? frame%runFrames : frame;
+        if(shadingSweep && runFrame==0){
+            activeLights=sweepLights[frame/runFrames/2];
+            deferredShading=(frame/runFrames)%2==1;
+            gravity=sweepStart;
+            recorder.reset(new rg::FrameRecorder());
+            lastFrame=0.0f;
+        }
+        clockFrame=runFrame;
+        float currentFrame = currentTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        bool recording=benchmark && runFrame>=warmupFrames;
+        if(recording)
+            recorder->beginFrame(runFrame-warmupFrames,currentFrame);
+
+
+        if(benchmark)
+            scriptedCamera(currentFrame,earthPosition,SaturnPosition,belt.radius);
+        else if(window)
+            processInput(window,earthPosition,SaturnPosition);
+        if(frame==traceStart && !tracePath.empty())
+            trace.capture(tracePath,(unsigned int)traceFrames);
+        if(traceRequested){
+            if(!trace.capture("trace.json",(unsigned int)traceFrames))
+                std::cout<<"A trace capture is already running"<<std::endl;
+            traceRequested=false;
+        }
+        profiler.beginFrame();
+        streamBuffer.beginFrame();
+        renderScale.enabled=dynamicResolution;
+        renderScale.beginFrame();
+        int sceneWidth=renderScale.scaledWidth(framebufferWidth);
+        int sceneHeight=renderScale.scaledHeight(framebufferHeight);
 
 
-        processInput(window,Info);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
-        glBindFramebuffer(GL_FRAMEBUFFER,hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),(float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 300.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),(float) framebufferWidth / (float) framebufferHeight, nearPlane, farPlane);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
 
         spotLight.position=camera.Position;
         spotLight.direction=camera.Front;
         spotLight.ambient=ambientSpot;
         spotLight.diffuse=dif;
         spotLight.specular=spec;
+        FrameConstants frameConstants={projection,view,glm::vec4(camera.Position,1.0f)};
+        streamBuffer.bindUniform(FrameConstantsBinding,frameConstants);
         //setup Shaders------------------------------------
+        // the deferred path draws with the programs writing the G-buffer and lights it in one pass
+        unsigned int lightingFeatures=FlashLight ? LIGHTING_FLASHLIGHT : 0;
+        unsigned int sceneFeatures=deferredShading ? (unsigned int)LIGHTING_DEFERRED : lightingFeatures;
+        Shader &planetShader=planetShaders.get(sceneFeatures);
+        Shader &rockShader=rockShaders.get(sceneFeatures);
+        Shader &deferredLightingShader=deferredLightingShaders.get(lightingFeatures);
+        shaders[PLANET_SHADER]=&planetShader;
+        shaders[ROCK_SHADER]=&rockShader;
+
+        glm::vec3 sunPosition=scene.worldPosition(store.transform(bodyEntities[0]).body);
+        setUpShader(planetShader,sunPosition,sunLight.specular,sunLight.diffuse,sunLight.ambient,sunLight.constant,sunLight.linear,sunLight.quadratic,true,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+        setUpShader(planetShader,spotLight.position,spotLight.specular,spotLight.diffuse,spotLight.ambient,spotLight.constant,spotLight.linear,spotLight.quadratic,false,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+
+        setUpShader(rockShader,sunPosition,sunLight.specular,sunLight.diffuse,sunLight.ambient,sunLight.constant,sunLight.linear,sunLight.quadratic,true,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+        setUpShader(rockShader,spotLight.position,spotLight.specular,spotLight.diffuse,spotLight.ambient,spotLight.constant,spotLight.linear,spotLight.quadratic,false,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+
+        setUpShader(deferredLightingShader,sunPosition,sunLight.specular,sunLight.diffuse,sunLight.ambient,sunLight.constant,sunLight.linear,sunLight.quadratic,true,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+        setUpShader(deferredLightingShader,spotLight.position,spotLight.specular,spotLight.diffuse,spotLight.ambient,spotLight.constant,spotLight.linear,spotLight.quadratic,false,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
+        deferredLightingShader.setMat4("inverseViewProjection",glm::inverse(projection*view));
+
+        const unsigned int shuttleFeatures[]={0,SHUTTLE_TRANSLUCENT};
+        for(unsigned int features : shuttleFeatures){
+            Shader &cubeShuttleShader=cubeShuttleShaders.get(features);
+            cubeShuttleShader.use();
+            cubeShuttleShader.setMat4("projection", projection);
+            cubeShuttleShader.setMat4("view", view);
+            cubeShuttleShader.setVec3("viewPosition", camera.Position);
+        }
 
-        setUpShader(planetShader,pointLight.position,pointLight.specular,pointLight.diffuse,pointLight.ambient,pointLight.constant,pointLight.linear,pointLight.quadratic,projection,view,camera.Position,true,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
-        setUpShader(planetShader,spotLight.position,spotLight.specular,spotLight.diffuse,spotLight.ambient,spotLight.constant,spotLight.linear,spotLight.quadratic,projection,view,camera.Position,false,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
-
-        setUpShader(rockShader,pointLight.position,pointLight.specular,pointLight.diffuse,pointLight.ambient,pointLight.constant,pointLight.linear,pointLight.quadratic,projection,view,camera.Position,true,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
-        setUpShader(rockShader,spotLight.position,spotLight.specular,spotLight.diffuse,spotLight.ambient,spotLight.constant,spotLight.linear,spotLight.quadratic,projection,view,camera.Position,false,spotLight.cutOff,spotLight.outerCutOff,spotLight.direction);
-
-
-        rockShader.setInt("FlashLight",FlashLight);
-        planetShader.setInt("FlashLight",FlashLight);
-
-        cubeShuttleShader.use();
-        cubeShuttleShader.setMat4("projection", projection);
-        cubeShuttleShader.setMat4("view", view);
-        cubeShuttleShader.setVec3("viewPosition", camera.Position);
-
-
-
-
-        // render sun--------------------------------------------
-        float time=(float)glfwGetTime();
-        sunShader.use();
-        sunShader.setMat4("projection", projection);
-        sunShader.setMat4("view", view);
-        model= glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(Info.sunScale));
-        model = glm::rotate(model,Info.sunRotationSpeed*time,glm::vec3(0.0,-1.0,0.0));
-        sunShader.setMat4("model", model);
-        sunModel.Draw(sunShader);
-
-        //render Earth-----------------------------------------------
-        planetShader.use();
-        Info.earthPosition=glm::vec3(Info.earthDistance*cos(time * Info.earthRotationSpeed),0,Info.earthDistance*sin(time * Info.earthRotationSpeed));
-
-
-        model = glm::mat4(1.0f);
-        model=glm::translate(model,Info.earthPosition);
-        model=glm::scale(model,glm::vec3(Info.earthScale));
-        model=glm::rotate(model,float(time*0.5),glm::vec3(0.0,1,0.0));
-        planetShader.setMat4("model", model);
-        earthModel.Draw(planetShader);
-
-
-
-        //render Moon-----------------------------------------
-        model=glm::mat4(1.0f);
-        model=glm::translate(model,Info.earthPosition);
-        model=glm::translate(model,glm::vec3(3*cos(time),0,3*sin(time)));
-        model=glm::scale(model,glm::vec3(Info.moonScale));
-        model=glm::rotate(model,float(time*0.7),glm::vec3(0.0,1.0,0.0));
-        planetShader.setMat4("model", model);
-        moonModel.Draw(planetShader);
-
-        //render Saturn--------------------------------------------
 
-        Info.SaturnPositon=glm::vec3(Info.SaturnDistance*cos(time * Info.SaturnRotationSpeed),0,Info.SaturnDistance*sin(time * Info.SaturnRotationSpeed));
 
-        model=glm::mat4(1.0f);
-        model=glm::translate(model,Info.SaturnPositon);
-        model=glm::scale(model,glm::vec3(Info.SaturnScale));
-        model=glm::rotate(model,float(0.1*time),glm::vec3(0.0,1.0,0.0));
-        planetShader.setMat4("model", model);
-        SaturnModel.Draw(planetShader);
 
+        //planet transforms-------------------------------------
+        {
+            rg::Profiler::Scope scope(profiler,"simulation",false);
+            float time=currentTime();
+            rg::updateOrbits(store,time,&jobs);
+            {
+                rg::Profiler::Scope gravityScope(profiler,"gravity",false);
+                gravity.advance(deltaTime,&jobs);
+                glm::vec3 planet=gravity.position(planetParticle);
+                for(int i=0;i<belt.numberOfAsteroids;i++)
+                    store.transform(rockEntities[i]).position=gravity.position(rockParticles[i])-planet;
+            }
+            rg::updateSpin(store,time,&jobs);
+            rg::syncSceneGraph(store,scene);
+            scene.update();
+            earthPosition=scene.worldPosition(store.transform(bodyEntities[EARTH]).body);
+            SaturnPosition=scene.worldPosition(store.transform(bodyEntities[SATURN]).body);
+        }
 
-        //Enable culling so asteroid inner sides dont render-------------------------
+        //rocks bouncing off each other and the shuttle, in the frame of the belt----------------
+        {
+            rg::Profiler::Scope scope(profiler,"collisions",false);
+            for(int i=0;i<belt.numberOfAsteroids;i++)
+                rockSpheres[i]={store.transform(rockEntities[i]).position,rockRadii[i]};
+            rockGrid.build(rockSpheres,&jobs);
+            rockGrid.findPairs(rockContacts,&jobs);
+            for(const rg::Contact &contact : rockContacts){
+                unsigned int a=rockParticles[contact.a],b=rockParticles[contact.b];
+                glm::vec3 va=gravity.velocity(a),vb=gravity.velocity(b);
+                // rocks already drifting apart are left to it
+                float approach=glm::dot(va-vb,contact.normal);
+                if(approach<=0.0f)
+                    continue;
+                float ma=gravity.mass(a),mb=gravity.mass(b);
+                float impulse=(1.0f+belt.restitution)*approach/(1.0f/ma+1.0f/mb);
+                gravity.setVelocity(a,va-impulse/ma*contact.normal);
+                gravity.setVelocity(b,vb+impulse/mb*contact.normal);
+            }
+            // the shuttle doesn't give way to the rocks, they bounce off it; flown, it is pushed
+            // out of them, the view follows from the next frame
+            if(inShuttle)
+                shuttlePosition=camera.Position;
+            glm::vec3 shuttleCenter=shuttlePosition-scene.worldPosition(beltNode);
+            shuttleContacts.clear();
+            rockGrid.collide(rg::AABB(shuttleCenter-glm::vec3(0.5f),shuttleCenter+glm::vec3(0.5f)),shuttleContacts);
+            glm::vec3 push(0.0f);
+            for(const rg::Contact &contact : shuttleContacts){
+                unsigned int rock=rockParticles[contact.a];
+                glm::vec3 velocity=gravity.velocity(rock);
+                float approach=glm::dot(velocity,contact.normal);
+                if(approach>0.0f)
+                    gravity.setVelocity(rock,velocity-(1.0f+belt.restitution)*approach*contact.normal);
+                push+=contact.normal*contact.depth;
+            }
+            if(inShuttle)
+                camera.Position+=push;
+        }
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        //local lights into the clusters of the view frustum, assigned on the worker threads----------
+        {
+            rg::Profiler::Scope scope(profiler,"light clusters",false);
+            clusterLights.clear();
+            store.forEach(rg::TransformComponent | rg::LightComponent,[&](rg::Archetype &a){
+                for(unsigned int i=0;i<a.size();i++){
+                    if(a.lights[i].range<=0.0f || (int)clusterLights.size()>=activeLights)
+                        continue;
+                    const rg::Transform &transform=a.transforms[i];
+                    const glm::mat4 &world=scene.worldMatrix(transform.body!=rg::SceneGraph::None ? transform.body : transform.pivot);
+                    clusterLights.push_back(rg::ClusterLight::from(a.lights[i],glm::vec3(world[3]),glm::normalize(glm::vec3(world[1]))));
+                }
+            });
+            lightClusters.assign(clusterLights,view,projection,&jobs);
+            lightClusters.upload();
+            streamBuffer.bindUniform(LightClustersBinding,lightClusters.constants(sceneWidth,sceneHeight));
+        }
 
-        //rocks ------------------------------------
-        rockShader.use();
-        for(int i=0;i<Info.numberOfAsteroids;i++){
-            model=glm::mat4(1.0f);
-            float x=radiusWithOffset[i]*cos(glfwGetTime()*0.1*(glm::radians(360.f)/Info.numberOfAsteroids)*i);
-            float y= yDisplacement[i];
-            float z = radiusWithOffset[i]*sin(glfwGetTime()*0.1*(glm::radians(360.f)/Info.numberOfAsteroids)*i);
-            model=glm::translate(model,Info.SaturnPositon);
-            model=glm::translate(model,glm::vec3(x,y,z));
-            model=glm::scale(model,glm::vec3(0.8f));
-            model = glm::rotate(model,(float)glfwGetTime()*angle[i], glm::vec3(0.4f, 0.6f,0.8f));
-            rockShader.setMat4("model",model);
-            glBindVertexArray(VAO);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D,rockTexDiffuse);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D,rockTexSpecular);
-            glDrawElements(GL_TRIANGLES,12,GL_UNSIGNED_INT,0);
-            glBindVertexArray(0);
+        //occlusion culling, the big spheres hide whatever is behind them--------------
+        {
+            rg::Profiler::Scope scope(profiler,"culling",false);
+            occlusion.clear();
+            occlusion.setViewProjection(projection*view);
+            store.forEach(rg::TransformComponent | rg::RenderableComponent,[&](rg::Archetype &a){
+                for(unsigned int i=0;i<a.size();i++){
+                    if(a.renderables[i].occluderRadius>0.0f)
+                        occlusion.drawMesh(occluderSphere,glm::scale(scene.worldMatrix(a.transforms[i].body),glm::vec3(a.renderables[i].occluderRadius)));
+                }
+            });
+            occlusion.buildHierarchy();
+
+            //rock culling ------------------------------------
+            for(int i=0;i<belt.numberOfAsteroids;i++)
+                rockBounds[i]=rg::AABB::fromSphere(scene.worldPosition(store.transform(rockEntities[i]).body),rockRadii[i]);
+            if(rockBVH.nodeCount()==0)
+                rockBVH.build(rockBounds);
+            else
+                rockBVH.refit(rockBounds);
+
+            visibleRocks.clear();
+            rg::Frustum frustum=rg::Frustum::fromMatrix(projection*view);
+            rockBVH.queryFrustum(frustum,rockBounds,[&](int i){
+                if(occlusion.isVisible(rockBounds[i]))
+                    visibleRocks.push_back(i);
+            });
+
+            //every mesh instance that survived into the render queue, then the sky and the shuttle--------
+            renderQueue.clear();
+            sceneDraws.clear();
+            auto submitMesh=[&](Shader *shader,const char *name,bool cullBackFaces,unsigned int mesh,const glm::mat4 &model){
+                float depth=glm::length(glm::vec3(model[3])-camera.Position);
+                uint32_t pipeline=rg::RenderQueue::pipeline(shader->ID,cullBackFaces ? 1 : 0);
+                renderQueue.submit(rg::RenderQueue::opaqueKey(pipeline,meshLayers[mesh],depth),(uint32_t)sceneDraws.size());
+                sceneDraws.push_back({shader,name,cullBackFaces,mesh,{model,meshLayers[mesh],{}}});
+            };
+            store.forEach(rg::TransformComponent | rg::RenderableComponent,[&](rg::Archetype &a){
+                for(unsigned int i=0;i<a.size();i++){
+                    const rg::Renderable &renderable=a.renderables[i];
+                    if(renderable.model==ROCK_MODEL)
+                        continue;
+                    rg::SceneGraph::Node body=a.transforms[i].body;
+                    if(!occlusion.isVisible(rg::AABB::fromSphere(scene.worldPosition(body),renderable.boundingRadius)))
+                        continue;
+                    // an instance per mesh, the meshes of a body can have different materials
+                    glm::mat4 model=scene.worldMatrix(body);
+                    for(unsigned int m=0;m<models[renderable.model]->meshes.size();m++)
+                        submitMesh(shaders[renderable.shader],"planets",false,firstMesh[renderable.model]+m,model);
+                }
+            });
+            // back faces culled so the inner sides of the rocks don't show
+            for(int i : visibleRocks)
+                submitMesh(&rockShader,"asteroids",true,firstMesh[ROCK_MODEL],scene.worldMatrix(store.transform(rockEntities[i]).body));
+            renderQueue.submit(rg::RenderQueue::backToFrontKey(rg::RenderQueue::Sky,rg::RenderQueue::pipeline(skyboxShader.ID),0,0.0f),SKYBOX_DRAW);
+            renderQueue.submit(rg::RenderQueue::backToFrontKey(rg::RenderQueue::Blended,rg::RenderQueue::pipeline(cubeShuttleShaders.get(SHUTTLE_TRANSLUCENT).ID),0,
+                                                               glm::length(shuttlePosition-camera.Position)),SHUTTLE_DRAW);
+        }
+        {
+            rg::Profiler::Scope scope(profiler,"render queue",false);
+            renderQueue.sort();
+            //runs of the sorted queue with the same program and culling become batches, and runs of
+            //instances of the same mesh within them instanced commands-----------------------
+            batches.clear();
+            instances.clear();
+            unsigned int lastMesh=0;
+            for(const rg::RenderQueue::Entry &entry : renderQueue.entries()){
+                if(rg::RenderQueue::pass(entry.key)!=rg::RenderQueue::Opaque){
+                    batches.push_back({nullptr,nullptr,false,{},(CustomDraw)entry.value});
+                    continue;
+                }
+                const SceneDraw &draw=sceneDraws[entry.value];
+                bool newBatch=batches.empty() || batches.back().shader!=draw.shader || batches.back().cullBackFaces!=draw.cullBackFaces;
+                if(newBatch)
+                    batches.push_back({draw.shader,draw.name,draw.cullBackFaces,{},NO_CUSTOM_DRAW});
+                std::vector<rg::SceneGeometry::DrawCommand> &commands=batches.back().commands;
+                if(!newBatch && draw.mesh==lastMesh)
+                    commands.back().instanceCount++;
+                else
+                    commands.push_back(sceneGeometry.command(draw.mesh,(unsigned int)instances.size()));
+                lastMesh=draw.mesh;
+                instances.push_back(draw.instance);
+            }
+        }
+        GLintptr instanceOffset=0;
+        if(!instances.empty())
+            instanceOffset=streamBuffer.write(instances.data(),instances.size()*sizeof(rg::SceneGeometry::Instance));
+        sceneGeometry.resetStats();
+
+        glm::vec2 sceneScale((float)sceneWidth/framebufferWidth,(float)sceneHeight/framebufferHeight);
+        if(bloomRadiusChanged){
+            glDeleteProgram(bloomBlurShader.ID);
+            bloomBlurShader=Shader("resources/shaders/bloom.vs","resources/shaders/bloomBlur.fs",rg::BlurKernel::linear(bloomRadius,bloomRadius/2.0f).glslConstants());
+            bloomBlurShader.use();
+            bloomBlurShader.setInt("image",0);
+            bloomRadiusChanged=false;
         }
-        glDisable(GL_CULL_FACE);
 
+        //frame graph: scene (or gbuffer -> lighting -> forward) -> bloom, luminance -> adaptation -> composite,
+        //unread branches are culled---------
+        frameGraph.reset();
+        rg::RenderTargetDesc hdrDesc(framebufferWidth,framebufferHeight,GL_RGBA16F);
+        rg::FrameGraph::Resource hdrColor=frameGraph.create("hdrColor",hdrDesc);
+        rg::FrameGraph::Resource hdrDepth=frameGraph.create("hdrDepth",rg::RenderTargetDesc(framebufferWidth,framebufferHeight,GL_DEPTH_COMPONENT24));
+        rg::FrameGraph::Resource bloomColor=frameGraph.create("bloom",rg::Bloom::mip0Desc(hdrDesc));
+        rg::FrameGraph::Resource backbuffer=frameGraph.import("backbuffer",presentFramebuffer,framebufferWidth,framebufferHeight);
+        // kept across frames, only measured and adapted while the tone mapping reads them
+        rg::FrameGraph::Resource luminance=frameGraph.import("luminance",autoExposure.luminanceFramebuffer(),autoExposure.size(),autoExposure.size(),false);
+        rg::FrameGraph::Resource adaptedLuminance=frameGraph.import("adaptedLum",autoExposure.adaptFramebuffer(),1,1,false);
 
         //cubeShuttle that's transparent only from inside---------------------------
-
-        glEnable(GL_CULL_FACE);
-        for(int i=0;i<2;i++){
-            if(i)
-                glCullFace(GL_FRONT);
-            else
-                glCullFace(GL_BACK);
-            cubeShuttleShader.use();
-            cubeShuttleShader.setInt("i",i);
-            model=glm::mat4(1.0f);
-            if(inShuttle){
-                shuttlePosition=camera.Position;
-                model=glm::translate(model,camera.Position);
-            }
-            else{
-                model=glm::translate(model,shuttlePosition);
+        auto drawShuttle=[&](){
+            rg::Profiler::Scope scope(profiler,"shuttle");
+            glEnable(GL_CULL_FACE);
+            for(int i=0;i<2;i++){
+                if(i)
+                    glCullFace(GL_FRONT);
+                else
+                    glCullFace(GL_BACK);
+                // the first pass draws the walls seen from inside, those are see-through
+                Shader &cubeShuttleShader=cubeShuttleShaders.get(i ? 0 : SHUTTLE_TRANSLUCENT);
+                cubeShuttleShader.use();
+                cubeShuttleShader.setMat4("model",glm::translate(glm::mat4(1.0f),shuttlePosition));
+                glBindVertexArray(cubeVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D,cubeTexture);
+                glDrawArrays(GL_TRIANGLES,0,36);
+                glBindVertexArray(0);
             }
-            cubeShuttleShader.setMat4("model",model);
-            glBindVertexArray(cubeVAO);
+            glDisable(GL_CULL_FACE);
+        };
+
+        //SkyBox----------------------------------
+        auto drawSkybox=[&](){
+            rg::Profiler::Scope scope(profiler,"skybox");
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+            skyboxShader.use();
+            skyboxShader.setMat4("view",glm::mat4(glm::mat3(view)));
+            skyboxShader.setMat4("projection",projection);
+            glBindVertexArray(skyboxVAO);
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D,cubeTexture);
+            glBindTexture(GL_TEXTURE_CUBE_MAP,cubemapTexture);
             glDrawArrays(GL_TRIANGLES,0,36);
             glBindVertexArray(0);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        };
+
+        // in render queue order: sun, planets and rocks front to back, one submission per program
+        // and no texture binds in between, then the sky, then the shuttle. The deferred path draws
+        // the opaque batches into the G-buffer and the custom ones after lighting it----------
+        auto drawBatches=[&](bool opaque,bool custom){
+            for(const DrawBatch &batch : batches){
+                if(batch.customDraw!=NO_CUSTOM_DRAW){
+                    if(custom && batch.customDraw==SKYBOX_DRAW)
+                        drawSkybox();
+                    else if(custom && batch.customDraw==SHUTTLE_DRAW)
+                        drawShuttle();
+                    continue;
+                }
+                if(!opaque)
+                    continue;
+                rg::Profiler::Scope batchScope(profiler,batch.name);
+                batch.shader->use();
+                if(batch.cullBackFaces){
+                    glEnable(GL_CULL_FACE);
+                    glCullFace(GL_BACK);
+                }
+                sceneGeometry.draw(streamBuffer,instanceOffset,batch.commands);
+                glDisable(GL_CULL_FACE);
+            }
+        };
+
+        if(deferredShading){
+            // albedo with the material id and a packed normal, 8 bytes a pixel next to the depth
+            rg::FrameGraph::Resource gAlbedo=frameGraph.create("gAlbedo",rg::RenderTargetDesc(framebufferWidth,framebufferHeight,GL_RGBA8));
+            rg::FrameGraph::Resource gNormal=frameGraph.create("gNormal",rg::RenderTargetDesc(framebufferWidth,framebufferHeight,GL_RG16F));
+
+            frameGraph.addPass("gbuffer",[&](rg::FrameGraph::Builder &builder){
+                builder.write(gAlbedo);
+                builder.write(gNormal);
+                builder.write(hdrDepth);
+                builder.setRenderArea(sceneWidth,sceneHeight);
+            },[&](rg::FrameGraph &){
+                rg::Profiler::Scope scope(profiler,"gbuffer");
+                // the material id is in alpha
+                glDisable(GL_BLEND);
+                materials.bind(0);
+                drawBatches(true,false);
+                glEnable(GL_BLEND);
+            });
+
+            // every pixel lit once, by the lights of the cluster it falls into
+            frameGraph.addPass("lighting",[&](rg::FrameGraph::Builder &builder){
+                builder.read(gAlbedo);
+                builder.read(gNormal);
+                builder.read(hdrDepth);
+                builder.write(hdrColor,true);
+                builder.setRenderArea(sceneWidth,sceneHeight);
+            },[&](rg::FrameGraph &graph){
+                rg::Profiler::Scope scope(profiler,"lighting");
+                deferredLightingShader.use();
+                lightClusters.bind(1);
+                glActiveTexture(GL_TEXTURE4);
+                glBindTexture(GL_TEXTURE_2D,graph.texture(gAlbedo));
+                glActiveTexture(GL_TEXTURE5);
+                glBindTexture(GL_TEXTURE_2D,graph.texture(gNormal));
+                glActiveTexture(GL_TEXTURE6);
+                glBindTexture(GL_TEXTURE_2D,graph.texture(hdrDepth));
+                glActiveTexture(GL_TEXTURE0);
+                glDisable(GL_DEPTH_TEST);
+                glBindVertexArray(quadVAO);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                glBindVertexArray(0);
+                glEnable(GL_DEPTH_TEST);
+            });
+
+            // the sky and the shuttle, depth tested against the G-buffer's depth
+            frameGraph.addPass("forward",[&](rg::FrameGraph::Builder &builder){
+                builder.write(hdrColor);
+                builder.write(hdrDepth);
+                builder.setRenderArea(sceneWidth,sceneHeight);
+            },[&](rg::FrameGraph &){
+                rg::Profiler::Scope scope(profiler,"forward");
+                drawBatches(false,true);
+            });
+        }
+        else{
+            frameGraph.addPass("scene",[&](rg::FrameGraph::Builder &builder){
+                builder.write(hdrColor);
+                builder.write(hdrDepth);
+                builder.setRenderArea(sceneWidth,sceneHeight);
+            },[&](rg::FrameGraph &){
+                rg::Profiler::Scope scope(profiler,"scene");
+                materials.bind(0);
+                lightClusters.bind(1);
+                drawBatches(true,true);
+            });
         }
-        glDisable(GL_CULL_FACE);
-
 
-        //SkyBox----------------------------------
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        skyboxShader.setMat4("view",glm::mat4(glm::mat3(view)));
-        skyboxShader.setMat4("projection",projection);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP,cubemapTexture);
-        glDrawArrays(GL_TRIANGLES,0,36);
-        glBindVertexArray(0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
-
-
-
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
-
-        bool horizontal = true;
-        bool first_iteration = true;
-        blurShader.use();
-        unsigned int amount = 10;
-        for (unsigned int i = 0; i < amount; ++i) {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setBool("horizontal", horizontal);
+        frameGraph.addPass("bloom",[&](rg::FrameGraph::Builder &builder){
+            builder.read(hdrColor);
+            builder.write(bloomColor,true);
+        },[&](rg::FrameGraph &graph){
+            rg::Profiler::Scope scope(profiler,"bloom");
+            bloomChain.sourceScale=sceneScale;
+            bloomChain.render(targets,graph.target(hdrColor),graph.target(bloomColor),bloomDownsampleShader,bloomUpsampleShader,quadVAO,bloomRadius>0 ? &bloomBlurShader : nullptr);
+        });
+
+        frameGraph.addPass("luminance",[&](rg::FrameGraph::Builder &builder){
+            builder.read(hdrColor);
+            builder.write(luminance,true);
+        },[&](rg::FrameGraph &graph){
+            rg::Profiler::Scope scope(profiler,"luminance");
+            autoExposure.measure(luminanceShader,graph.texture(hdrColor),sceneScale,quadVAO);
+        });
+
+        frameGraph.addPass("adaptation",[&](rg::FrameGraph::Builder &builder){
+            builder.read(luminance);
+            builder.write(adaptedLuminance,true);
+        },[&](rg::FrameGraph &){
+            rg::Profiler::Scope scope(profiler,"adaptation");
+            autoExposure.adapt(adaptExposureShader,deltaTime,quadVAO);
+        });
+
+        frameGraph.addPass("composite",[&](rg::FrameGraph::Builder &builder){
+            builder.read(hdrColor);
+            if(bloom)
+                builder.read(bloomColor);
+            if(hdr)
+                builder.read(adaptedLuminance);
+            builder.write(backbuffer,true);
+        },[&](rg::FrameGraph &graph){
+            rg::Profiler::Scope scope(profiler,"composite");
+            unsigned int features=(bloom ? POST_BLOOM : 0)|(hdr ? POST_HDR : invert ? POST_INVERT : greyScale ? POST_GREYSCALE : 0);
+            Shader &hdrShader=hdrShaders.get(features);
+            hdrShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D,graph.texture(hdrColor));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D,bloom ? graph.texture(bloomColor) : 0);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D,autoExposure.adaptedTexture());
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? collorBuffer[i] : pingpongColorBuffers[!horizontal]);
+            hdrShader.setFloat("bloomStrength",1.0f/bloomChain.mipCount());
+            hdrShader.setFloat("keyValue",autoExposure.keyValue);
+            hdrShader.setFloat("exposureCompensation",exposureCompensation);
+            hdrShader.setVec2("renderScale",sceneScale);
+            hdrShader.setFloat("sharpness",renderScale.sharpness());
+            // the quad covers the whole backbuffer, so neither its color nor its depth is cleared
+            glDisable(GL_DEPTH_TEST);
             glBindVertexArray(quadVAO);
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
             glBindVertexArray(0);
-            horizontal = !horizontal;
-            if (first_iteration) {
-                first_iteration = false;
-            }
+            glEnable(GL_DEPTH_TEST);
+        });
+
+        if(window && showProfiler){
+            frameGraph.addPass("profiler",[&](rg::FrameGraph::Builder &builder){
+                builder.write(backbuffer);
+            },[&](rg::FrameGraph &){
+                rg::Profiler::Scope scope(profiler,"ui");
+                ImGui_ImplOpenGL3_NewFrame();
+                ImGui_ImplGlfw_NewFrame();
+                ImGui::NewFrame();
+                drawProfilerPanel(profiler);
+                ImGui::Render();
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            });
         }
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
 
+        frameGraph.compile();
+        frameGraph.execute();
+        streamBuffer.endFrame();
+        renderScale.endFrame();
+        targets.endFrame();
+        if(dumpFrameGraph){
+            frameGraph.dump(std::cout);
+            // what the BrightColor attachment the scene pass no longer writes would cost: its
+            // RGBA16F memory, and a clear and at least one write of every drawn pixel
+            double brightTargetMB=framebufferWidth*framebufferHeight*8.0/(1024.0*1024.0);
+            double brightTrafficMB=2.0*sceneWidth*sceneHeight*8.0/(1024.0*1024.0);
+            std::cout<<"HDR target without the BrightColor attachment: "<<brightTargetMB<<" MB less memory, at least "
+                     <<brightTrafficMB<<" MB less clear + write traffic per frame, the passes writing it are timed above"<<std::endl;
+            std::cout<<"Adapted luminance "<<autoExposure.averageLuminance()<<", exposure "
+                     <<autoExposure.keyValue/autoExposure.averageLuminance()*std::exp2(exposureCompensation)
+                     <<" ("<<exposureCompensation<<" EV compensation)"<<std::endl;
+            const rg::SceneGeometry::Stats &draws=sceneGeometry.stats();
+            std::cout<<"Scene geometry: "<<draws.drawCalls<<" draw calls for "<<draws.commands<<" commands, "
+                     <<draws.meshDraws<<" with one draw per mesh, "<<renderQueue.size()<<" render queue entries"<<std::endl;
+            unsigned int permutations=0,lateCompiles=0;
+            for(const rg::ShaderPermutations *shaders : {&planetShaders,&rockShaders,&deferredLightingShaders,&hdrShaders,&cubeShuttleShaders}){
+                permutations+=shaders->size();
+                lateCompiles+=shaders->lateCompiles();
+            }
+            std::cout<<"Shader permutations: "<<permutations<<" programs, "<<lateCompiles<<" of them compiled on first use"<<std::endl;
+            std::cout<<"Materials: "<<materials.layerCount()<<" layers, "<<materials.memorySize()/(1024*1024)<<" MB"<<std::endl;
+            const rg::LightClusters::Stats &clusters=lightClusters.stats();
+            std::cout<<"Light clusters: "<<clusters.lights<<" lights in "<<clusters.occupiedCells<<" of "<<rg::LightClusters::CellCount
+                     <<" clusters, "<<clusters.assignments<<" assignments, at most "<<clusters.maxPerCell<<" per cluster, "
+                     <<clusters.dropped<<" dropped"<<std::endl;
+            const rg::SpatialHashGrid::Stats &collisionStats=rockGrid.stats();
+            std::cout<<"Collisions: "<<collisionStats.bodies<<" rocks in "<<collisionStats.cells
+                     <<" cells "<<collisionStats.cellSize<<" across, at most "<<collisionStats.maxPerCell<<" per cell, "
+                     <<collisionStats.tests<<" sphere tests, "<<collisionStats.pairs<<" touching pairs, "<<collisionStats.boxContacts
+                     <<" touching the shuttle, build "<<collisionStats.buildMilliseconds<<" ms, pairs "
+                     <<collisionStats.pairMilliseconds<<" ms"<<std::endl;
+            const rg::NBody::Stats &gravityStats=gravity.stats();
+            std::cout<<"Gravity: "<<gravity.size()<<" particles, "<<gravityStats.nodes<<" tree nodes, "<<gravityStats.leaves<<" leaves, "
+                     <<gravityStats.groups<<" groups, "<<gravityStats.interactions<<" interactions per particle, tree "
+                     <<gravityStats.treeMilliseconds<<" ms, forces "<<gravityStats.forceMilliseconds<<" ms, step "
+                     <<gravityStats.stepMilliseconds<<" ms"<<std::endl;
+            std::cout<<"Stream buffer: "<<streamBuffer.used()<<" of "<<streamBuffer.frameSize()<<" bytes used this frame, "
+                     <<streamBuffer.stalls()<<" stalls, "<<(streamBuffer.persistent() ? "persistently mapped" : "mapped per allocation")<<std::endl;
+            dumpFrameGraph=false;
+        }
+        profiler.endFrame();
+        if(recording)
+            recorder->endFrame();
+        if(shadingSweep && runFrame==runFrames-1){
+            recorder->finish();
+            sweepRuns.push_back({activeLights,deferredShading,recorder->summarize(&rg::FrameRecorder::Frame::cpuMilliseconds),
+                                 recorder->summarize(&rg::FrameRecorder::Frame::gpuMilliseconds)});
+        }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        hdrShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D,collorBuffer[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D,pingpongColorBuffers[!horizontal]);
-        hdrShader.setInt("bloom",bloom);
-        hdrShader.setInt("hdr",hdr);
-        hdrShader.setFloat("exposure",exposure);
-        hdrShader.setInt("invert",invert);
-        hdrShader.setInt("greyScale",greyScale);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
 
+        if(window){
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        frame++;
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    trace.finish();
+    if(shadingSweep){
+        // one row per run, forward and deferred next to each other
+        std::ofstream out(csvPath);
+        out<<"lights,shading,cpu_mean_ms,gpu_mean_ms,gpu_p95_ms,gpu_p99_ms\n"<<std::fixed<<std::setprecision(4);
+        rg::BenchmarkTable table({"lights","shading","cpu mean","gpu mean","gpu p95","gpu p99"});
+        for(const ShadingSweepRun &run : sweepRuns){
+            const char *shading=run.deferred ? "deferred" : "forward";
+            out<<run.lights<<','<<shading<<','<<run.cpu.mean<<','<<run.gpu.mean<<','<<run.gpu.p95<<','<<run.gpu.p99<<'\n';
+            table.row(run.lights,shading,run.cpu.mean,run.gpu.mean,run.gpu.p95,run.gpu.p99);
+        }
+        if(!out)
+            std::cout<<"Failed to write "<<csvPath<<std::endl;
+        else
+            std::cout<<"Shading sweep written to "<<csvPath<<std::endl;
+    }
+    else if(benchmark){
+        recorder->finish();
+        if(!recorder->writeCSV(csvPath) || !recorder->writeSummaryCSV(summaryPath(csvPath)))
+            std::cout<<"Failed to write "<<csvPath<<std::endl;
+        else
+            std::cout<<"Frame times written to "<<csvPath<<" and "<<summaryPath(csvPath)<<std::endl;
+    }
+    if(headless){
+        glFinish();
+        double seconds=runTime.elapsedMilliseconds()/1000.0;
+        std::cout<<frame<<" frames in "<<seconds<<" s, "<<seconds*1000.0/std::max(frame,1)<<" ms per frame"<<std::endl;
+        frameGraph.dump(std::cout);
+        profiler.print(std::cout);
+        std::cout<<"Last frame: "<<sceneGeometry.stats().drawCalls<<" scene draw calls for "<<sceneGeometry.stats().meshDraws
+                 <<" mesh draws"<<std::endl;
+        if(!screenshotPath.empty() && !headlessContext->writePPM(screenshotPath))
+            std::cout<<"Failed to write "<<screenshotPath<<std::endl;
+        return 0;
     }
 
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -718,7 +1522,7 @@ int main() {
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window,PlanetsInfo Info) {
+void processInput(GLFWwindow *window,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -731,22 +1535,10 @@ void processInput(GLFWwindow *window,PlanetsInfo Info) {
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
 
-    if (glfwGetKey(window,GLFW_KEY_F1) == GLFW_PRESS){
-        camera.Position=glm::vec3(Info.earthPosition - glm::vec3(0,0,5));
-        camera.Front=Info.earthPosition-camera.Position;
-    }
-    if (glfwGetKey(window,GLFW_KEY_F2) == GLFW_PRESS){
-        camera.Position=glm::vec3(Info.earthPosition + glm::vec3(0,10,0));
-        camera.Front=Info.earthPosition-camera.Position;
-    }
-
-    if (glfwGetKey(window,GLFW_KEY_F3) == GLFW_PRESS){
-        camera.Position=glm::vec3(Info.SaturnPositon - glm::vec3(0,0,30));
-        camera.Front=Info.SaturnPositon-camera.Position;
-    }
-    if (glfwGetKey(window,GLFW_KEY_F4) == GLFW_PRESS){
-        camera.Position=glm::vec3(Info.SaturnPositon + glm::vec3(0,40,0));
-        camera.Front=Info.SaturnPositon-camera.Position;
+    const int viewpointKeys[]={GLFW_KEY_F1,GLFW_KEY_F2,GLFW_KEY_F3,GLFW_KEY_F4};
+    for(int i=0;i<4;i++){
+        if (glfwGetKey(window,viewpointKeys[i]) == GLFW_PRESS)
+            setViewpoint(i,earthPosition,SaturnPosition);
     }
 
     if(glfwGetKey(window,GLFW_KEY_LEFT_SHIFT)==GLFW_PRESS){
@@ -759,12 +1551,38 @@ void processInput(GLFWwindow *window,PlanetsInfo Info) {
 
 }
 
+// F1-F4: in front of and above the Earth, in front of and above Saturn
+void setViewpoint(int viewpoint,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition){
+    const glm::vec3 offsets[]={glm::vec3(0,0,-5),glm::vec3(0,10,0),glm::vec3(0,0,-30),glm::vec3(0,40,0)};
+    glm::vec3 target=viewpoint<2 ? earthPosition : SaturnPosition;
+    camera.Position=target+offsets[viewpoint];
+    camera.Front=target-camera.Position;
+}
+
+// The benchmark's camera: 3 s at each of the F1-F4 viewpoints, then 8 s in the shuttle flying
+// half way around Saturn along the asteroid belt, where the most rocks are in view. Repeats
+// every 20 s of simulated time.
+void scriptedCamera(float time,const glm::vec3 &earthPosition,const glm::vec3 &SaturnPosition,float beltRadius){
+    float t=std::fmod(time,20.0f);
+    if(t<12.0f){
+        setViewpoint((int)(t/3.0f),earthPosition,SaturnPosition);
+        return;
+    }
+    float angle=glm::radians(180.0f)*(t-12.0f)/8.0f;
+    camera.Position=SaturnPosition+glm::vec3(beltRadius*std::cos(angle),1.5f,beltRadius*std::sin(angle));
+    // along the belt, turned a little towards Saturn
+    camera.Front=glm::normalize(glm::vec3(-std::sin(angle),-0.05f,std::cos(angle))*0.9f
+                                +glm::normalize(SaturnPosition-camera.Position)*0.1f);
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    framebufferWidth=width;
+    framebufferHeight=height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -813,30 +1631,43 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         inShuttle=!inShuttle;
     }
 
-    if(key==GLFW_KEY_Q && action==GLFW_PRESS){
-        if(exposure>0.0f)
-            exposure-=0.03f;
-        else
-            exposure=0.0f;
+    if(key==GLFW_KEY_Q && action==GLFW_PRESS && exposureCompensation>-4.0f){
+        exposureCompensation-=0.25f;
     }
-    if(key==GLFW_KEY_E && action==GLFW_PRESS){
-        exposure+=0.03;
+    if(key==GLFW_KEY_E && action==GLFW_PRESS && exposureCompensation<4.0f){
+        exposureCompensation+=0.25f;
     }
     if(key==GLFW_KEY_F && action==GLFW_PRESS){
-        if(!FlashLight){
-            dif=glm::vec3(0);
-            spec=glm::vec3(0);
-            FlashLight=!FlashLight;
-        }
-        else{
-            dif=glm::vec3(1);
-            spec=glm::vec3(1);
-            FlashLight=!FlashLight;
-        }
+        FlashLight=!FlashLight;
+        dif=glm::vec3(FlashLight ? 1.0f : 0.0f);
+        spec=glm::vec3(FlashLight ? 1.0f : 0.0f);
     }
     if(key==GLFW_KEY_B && action==GLFW_PRESS){
         bloom=!bloom;
     }
+    if(key==GLFW_KEY_L && action==GLFW_PRESS){
+        deferredShading=!deferredShading;
+    }
+    if(key==GLFW_KEY_R && action==GLFW_PRESS){
+        dynamicResolution=!dynamicResolution;
+    }
+    if(key==GLFW_KEY_G && action==GLFW_PRESS){
+        dumpFrameGraph=true;
+    }
+    if(key==GLFW_KEY_P && action==GLFW_PRESS){
+        showProfiler=!showProfiler;
+    }
+    if(key==GLFW_KEY_T && action==GLFW_PRESS){
+        traceRequested=true;
+    }
+    if(key==GLFW_KEY_LEFT_BRACKET && action==GLFW_PRESS && bloomRadius>0){
+        bloomRadius--;
+        bloomRadiusChanged=true;
+    }
+    if(key==GLFW_KEY_RIGHT_BRACKET && action==GLFW_PRESS && bloomRadius<16){
+        bloomRadius++;
+        bloomRadiusChanged=true;
+    }
 }
 unsigned int loadTexture(char const * path)
 {
@@ -906,12 +1737,122 @@ unsigned int loadCubemap(vector<std::string> faces)
 
     return textureID;
 }
+int runBenchmark(const std::string &name){
+    if(name=="bvh"){
+        rg::benchmarkSpatialIndex();
+        return 0;
+    }
+    if(name=="occlusion"){
+        rg::benchmarkOcclusionCulling();
+        return 0;
+    }
+    if(name=="ecs"){
+        rg::benchmarkEntityStore();
+        return 0;
+    }
+    if(name=="blur"){
+        rg::benchmarkBlurKernel();
+        return 0;
+    }
+    if(name=="clusters"){
+        rg::benchmarkLightClusters();
+        return 0;
+    }
+    if(name=="nbody"){
+        rg::benchmarkNBody();
+        return 0;
+    }
+    if(name=="collisions"){
+        rg::benchmarkCollisions();
+        return 0;
+    }
+    std::cout << "Unknown benchmark: " << name << std::endl;
+    return -1;
+}
+
+// bounding sphere of the model, and a sphere that fits inside it for the occlusion rasterizer;
+// the smallest half extent keeps Saturn's rings out of its occluder
+ModelRadius measureModel(const Model &model){
+    glm::vec3 lo(std::numeric_limits<float>::max()),hi(-std::numeric_limits<float>::max());
+    float bounding=0.0f;
+    for(const Mesh &mesh : model.meshes){
+        for(const Vertex &vertex : mesh.vertices){
+            lo=glm::min(lo,vertex.Position);
+            hi=glm::max(hi,vertex.Position);
+            bounding=std::max(bounding,glm::length(vertex.Position));
+        }
+    }
+    glm::vec3 halfExtent=glm::min(glm::abs(lo),glm::abs(hi));
+    ModelRadius radius;
+    radius.bounding=bounding;
+    radius.occluder=0.95f*std::max(0.0f,std::min(halfExtent.x,std::min(halfExtent.y,halfExtent.z)));
+    return radius;
+}
+
+float currentTime(){
+    if(fixedClock)
+        return clockFrame*FixedTimeStep;
+    return (float)(startupClock.elapsedMilliseconds()/1000.0);
+}
+
+// benchmark.csv -> benchmark_summary.csv
+std::string summaryPath(const std::string &csvPath){
+    std::string::size_type dot=csvPath.find_last_of('.');
+    std::string::size_type slash=csvPath.find_last_of("/\\");
+    if(dot==std::string::npos || (slash!=std::string::npos && slash>dot))
+        return csvPath+"_summary";
+    return csvPath.substr(0,dot)+"_summary"+csvPath.substr(dot);
+}
+
+// Rolling graphs of the frame time and the GPU time of the frame, and a table with the average
+// CPU and GPU time of every profiler scope over the same frames. Display only, the mouse
+// belongs to the camera.
+void drawProfilerPanel(const rg::Profiler &profiler){
+    ImGui::SetNextWindowPos(ImVec2(10.0f,10.0f),ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    ImGui::Begin("Profiler",nullptr,ImGuiWindowFlags_AlwaysAutoResize|ImGuiWindowFlags_NoInputs);
+
+    const std::vector<float> &frameTimes=profiler.frameMilliseconds();
+    float frameAverage=rg::Profiler::average(frameTimes);
+    char overlay[64];
+    snprintf(overlay,sizeof(overlay),"%.2f ms (%.0f fps)",frameAverage,frameAverage>0.0f ? 1000.0f/frameAverage : 0.0f);
+    ImGui::PlotLines("frame",frameTimes.data(),(int)frameTimes.size(),(int)profiler.frameHistoryOffset(),overlay,0.0f,2.0f*frameAverage,ImVec2(320.0f,60.0f));
+    if(!profiler.treeOrder().empty()){
+        // the root scope, the whole frame on the GPU
+        const rg::Profiler::Section &root=profiler.sections()[profiler.treeOrder()[0]];
+        float gpuAverage=rg::Profiler::average(root.gpuMilliseconds);
+        snprintf(overlay,sizeof(overlay),"%.2f ms",gpuAverage);
+        ImGui::PlotLines("gpu",root.gpuMilliseconds.data(),(int)root.gpuMilliseconds.size(),(int)root.next,overlay,0.0f,2.0f*gpuAverage,ImVec2(320.0f,60.0f));
+    }
+
+    if(ImGui::BeginTable("scopes",3,ImGuiTableFlags_RowBg|ImGuiTableFlags_BordersInnerV)){
+        ImGui::TableSetupColumn("scope");
+        ImGui::TableSetupColumn("cpu ms");
+        ImGui::TableSetupColumn("gpu ms");
+        ImGui::TableHeadersRow();
+        for(int i : profiler.treeOrder()){
+            const rg::Profiler::Section &section=profiler.sections()[i];
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s",2*section.depth,"",section.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f",rg::Profiler::average(section.cpuMilliseconds));
+            ImGui::TableNextColumn();
+            if(section.gpu)
+                ImGui::Text("%.3f",rg::Profiler::average(section.gpuMilliseconds));
+        }
+        ImGui::EndTable();
+    }
+    if(profiler.droppedFrames())
+        ImGui::Text("%u frames without GPU times",profiler.droppedFrames());
+    ImGui::End();
+}
+
 int getRandNumber(int min,int max){
     return (min + (rand()%(max-min+1)));
 }
 
 
-void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 diffuse,glm::vec3 ambient,float constant,float linear,float quadratic,glm::mat4 projection,glm::mat4 view,glm::vec3 camPosition,bool point_spot,float cutOff,float outerCutoff,glm::vec3 direction){
+void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 diffuse,glm::vec3 ambient,float constant,float linear,float quadratic,bool point_spot,float cutOff,float outerCutoff,glm::vec3 direction){
     if(point_spot){
         shader.use();
         shader.setVec3("pointLight.position", position);
@@ -921,9 +1862,6 @@ void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 d
         shader.setFloat("pointLight.constant", constant);
         shader.setFloat("pointLight.linear", linear);
         shader.setFloat("pointLight.quadratic", quadratic);
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        shader.setVec3("viewPosition", camPosition);
     }
     else{
         shader.use();
@@ -937,10 +1875,6 @@ void setUpShader(Shader shader,glm::vec3 position,glm::vec3 specular,glm::vec3 d
         shader.setFloat("spotLight.quadratic", quadratic);
         shader.setFloat("cutOff",cutOff);
         shader.setFloat("outerCutOff",outerCutoff);
-
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        shader.setVec3("viewPosition", camPosition);
     }
 
 }